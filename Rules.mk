@@ -2,6 +2,7 @@ CROSS_COMPILE=
 
 CC=$(CROSS_COMPILE)gcc
 AR=$(CROSS_COMPILE)ar
+SIZE=$(CROSS_COMPILE)size
 
 CFLAGS = -Wall -Werror -g
 ARFLAGS = -rv
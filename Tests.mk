@@ -7,7 +7,12 @@ $(BUILD_DIR)/cli_client  \
 $(BUILD_DIR)/ssl_server  \
 $(BUILD_DIR)/ssl_client  \
 $(BUILD_DIR)/dns_client  \
-$(BUILD_DIR)/pipe_test  
+$(BUILD_DIR)/pipe_test  \
+$(BUILD_DIR)/ktls_bench  \
+$(BUILD_DIR)/hs_bench  \
+$(BUILD_DIR)/layout_bench  \
+$(BUILD_DIR)/trace_dump  \
+$(BUILD_DIR)/echo_bench  
 
 .PHONY: tests
 tests: $(TEST_TARGETS)
@@ -20,7 +25,7 @@ vpath %.c $(sort $(dir $(CLI_SERVER_SRC)))
 
 $(BUILD_DIR)/cli_server: $(BUILD_DIR)/$(TARGET) $(CLI_SERVER_OBJS)
 	@echo "[LD]         $@"
-	$Q$(CC) $(CLI_SERVER_OBJS) $(LDFLAGS) -o $@ -liodriver -lmbedtls -lmbedx509 -lmbedcrypto
+	$Q$(CC) $(CLI_SERVER_OBJS) $(LDFLAGS) -o $@ -liodriver -lmbedtls -lmbedx509 -lmbedcrypto -lpthread
 
 CLI_CLIENT_SRC= \
 test/cli_client.c
@@ -29,7 +34,7 @@ vpath %.c $(sort $(dir $(CLI_CLIENT_SRC)))
 
 $(BUILD_DIR)/cli_client: $(BUILD_DIR)/$(TARGET) $(CLI_CLIENT_OBJS)
 	@echo "[LD]         $@"
-	$Q$(CC) $(CLI_CLIENT_OBJS) $(LDFLAGS) -o $@ -liodriver -lmbedtls -lmbedx509 -lmbedcrypto
+	$Q$(CC) $(CLI_CLIENT_OBJS) $(LDFLAGS) -o $@ -liodriver -lmbedtls -lmbedx509 -lmbedcrypto -lpthread
 
 SSL_SERVER_SRC= \
 test/ssl_server.c
@@ -38,7 +43,7 @@ vpath %.c $(sort $(dir $(SSL_SERVER_SRC)))
 
 $(BUILD_DIR)/ssl_server: $(BUILD_DIR)/$(TARGET) $(SSL_SERVER_OBJS)
 	@echo "[LD]         $@"
-	$Q$(CC) $(SSL_SERVER_OBJS) $(LDFLAGS) -o $@ -liodriver -lmbedtls -lmbedx509 -lmbedcrypto
+	$Q$(CC) $(SSL_SERVER_OBJS) $(LDFLAGS) -o $@ -liodriver -lmbedtls -lmbedx509 -lmbedcrypto -lpthread
 
 SSL_CLIENT_SRC= \
 test/ssl_client.c
@@ -47,7 +52,7 @@ vpath %.c $(sort $(dir $(SSL_CLIENT_SRC)))
 
 $(BUILD_DIR)/ssl_client: $(BUILD_DIR)/$(TARGET) $(SSL_CLIENT_OBJS)
 	@echo "[LD]         $@"
-	$Q$(CC) $(SSL_CLIENT_OBJS) $(LDFLAGS) -o $@ -liodriver -lmbedtls -lmbedx509 -lmbedcrypto
+	$Q$(CC) $(SSL_CLIENT_OBJS) $(LDFLAGS) -o $@ -liodriver -lmbedtls -lmbedx509 -lmbedcrypto -lpthread
 
 DNS_CLIENT_SRC= \
 test/dns_client.c
@@ -56,7 +61,7 @@ vpath %.c $(sort $(dir $(DNS_CLIENT_SRC)))
 
 $(BUILD_DIR)/dns_client: $(BUILD_DIR)/$(TARGET) $(DNS_CLIENT_OBJS)
 	@echo "[LD]         $@"
-	$Q$(CC) $(DNS_CLIENT_OBJS) $(LDFLAGS) -o $@ -liodriver -lmbedtls -lmbedx509 -lmbedcrypto
+	$Q$(CC) $(DNS_CLIENT_OBJS) $(LDFLAGS) -o $@ -liodriver -lmbedtls -lmbedx509 -lmbedcrypto -lpthread
 
 PIPE_TEST_SRC= \
 test/pipe_test.c
@@ -65,4 +70,62 @@ vpath %.c $(sort $(dir $(PIPE_TEST_SRC)))
 
 $(BUILD_DIR)/pipe_test: $(BUILD_DIR)/$(TARGET) $(PIPE_TEST_OBJS)
 	@echo "[LD]         $@"
-	$Q$(CC) $(PIPE_TEST_OBJS) $(LDFLAGS) -o $@ -liodriver -lmbedtls -lmbedx509 -lmbedcrypto
+	$Q$(CC) $(PIPE_TEST_OBJS) $(LDFLAGS) -o $@ -liodriver -lmbedtls -lmbedx509 -lmbedcrypto -lpthread
+
+KTLS_BENCH_SRC= \
+test/ktls_bench.c
+KTLS_BENCH_OBJS = $(addprefix $(BUILD_DIR)/,$(notdir $(KTLS_BENCH_SRC:.c=.o)))
+vpath %.c $(sort $(dir $(KTLS_BENCH_SRC)))
+
+$(BUILD_DIR)/ktls_bench: $(BUILD_DIR)/$(TARGET) $(KTLS_BENCH_OBJS)
+	@echo "[LD]         $@"
+	$Q$(CC) $(KTLS_BENCH_OBJS) $(LDFLAGS) -o $@ -liodriver -lmbedtls -lmbedx509 -lmbedcrypto -lpthread
+
+HS_BENCH_SRC= \
+test/hs_bench.c
+HS_BENCH_OBJS = $(addprefix $(BUILD_DIR)/,$(notdir $(HS_BENCH_SRC:.c=.o)))
+vpath %.c $(sort $(dir $(HS_BENCH_SRC)))
+
+$(BUILD_DIR)/hs_bench: $(BUILD_DIR)/$(TARGET) $(HS_BENCH_OBJS)
+	@echo "[LD]         $@"
+	$Q$(CC) $(HS_BENCH_OBJS) $(LDFLAGS) -o $@ -liodriver -lmbedtls -lmbedx509 -lmbedcrypto -lpthread
+
+LAYOUT_BENCH_SRC= \
+test/layout_bench.c
+LAYOUT_BENCH_OBJS = $(addprefix $(BUILD_DIR)/,$(notdir $(LAYOUT_BENCH_SRC:.c=.o)))
+vpath %.c $(sort $(dir $(LAYOUT_BENCH_SRC)))
+
+$(BUILD_DIR)/layout_bench: $(BUILD_DIR)/$(TARGET) $(LAYOUT_BENCH_OBJS)
+	@echo "[LD]         $@"
+	$Q$(CC) $(LAYOUT_BENCH_OBJS) $(LDFLAGS) -o $@ -liodriver -lmbedtls -lmbedx509 -lmbedcrypto -lpthread
+
+TRACE_DUMP_SRC= \
+test/trace_dump.c
+TRACE_DUMP_OBJS = $(addprefix $(BUILD_DIR)/,$(notdir $(TRACE_DUMP_SRC:.c=.o)))
+vpath %.c $(sort $(dir $(TRACE_DUMP_SRC)))
+
+$(BUILD_DIR)/trace_dump: $(BUILD_DIR)/$(TARGET) $(TRACE_DUMP_OBJS)
+	@echo "[LD]         $@"
+	$Q$(CC) $(TRACE_DUMP_OBJS) $(LDFLAGS) -o $@ -liodriver -lmbedtls -lmbedx509 -lmbedcrypto -lpthread
+
+ECHO_BENCH_SRC= \
+test/echo_bench.c
+ECHO_BENCH_OBJS = $(addprefix $(BUILD_DIR)/,$(notdir $(ECHO_BENCH_SRC:.c=.o)))
+vpath %.c $(sort $(dir $(ECHO_BENCH_SRC)))
+
+$(BUILD_DIR)/echo_bench: $(BUILD_DIR)/$(TARGET) $(ECHO_BENCH_OBJS)
+	@echo "[LD]         $@"
+	$Q$(CC) $(ECHO_BENCH_OBJS) $(LDFLAGS) -o $@ -liodriver -lmbedtls -lmbedx509 -lmbedcrypto -lpthread
+
+#######################################
+# loopback echo benchmark.
+# make bench [BENCH_MODE=tcp|tls|all] [BENCH_SEC=seconds per case] [BENCH_OUT=json file]
+#######################################
+BENCH_MODE  ?= all
+BENCH_SEC   ?= 2
+BENCH_OUT   ?= $(BUILD_DIR)/bench.json
+
+.PHONY: bench
+bench: $(BUILD_DIR)/echo_bench
+	$Q$(BUILD_DIR)/echo_bench $(BENCH_MODE) $(BENCH_SEC) $(BENCH_OUT)
+	@echo "[BENCH]      $(BENCH_OUT)"
@@ -5,7 +5,7 @@
 
 /*
  * initializes circular buffer
- * allocates a circular buffer of size "size"
+ * allocates a circular buffer of size "size" from default allocator
  *
  * @param cb   circular buffer
  * @param size size of circular buffer
@@ -13,20 +13,37 @@
  */
 int
 circ_buffer_init(circ_buffer_t* cb, int size)
+{
+  return circ_buffer_init_with_allocator(cb, size, io_allocator_default());
+}
+
+/*
+ * initializes circular buffer
+ * allocates a circular buffer of size "size" from allocator a
+ *
+ * @param cb   circular buffer
+ * @param size size of circular buffer
+ * @param a    allocator
+ * @return 0 on success, -1 on fail
+ */
+int
+circ_buffer_init_with_allocator(circ_buffer_t* cb, int size, io_allocator_t* a)
 {
   cb->buffer     = NULL;
   cb->size       = 0;
   cb->begin      = 0;
   cb->end        = 0;
   cb->data_size  = 0;
+  cb->allocator  = NULL;
 
-  cb->buffer = (uint8_t*)malloc(size);
+  cb->buffer = (uint8_t*)io_alloc(a, io_alloc_buffer, size);
   if(cb->buffer == NULL)
   {
     return -1;
   }
 
   cb->size       = size;
+  cb->allocator  = a;
   return 0;
 }
 
@@ -38,6 +55,7 @@ circ_buffer_init_with_mem(circ_buffer_t* cb, uint8_t* buf, int size)
   cb->begin      = 0;
   cb->end        = 0;
   cb->data_size  = 0;
+  cb->allocator  = NULL;
 }
 
 /*
@@ -49,9 +67,9 @@ circ_buffer_init_with_mem(circ_buffer_t* cb, uint8_t* buf, int size)
 void
 circ_buffer_deinit(circ_buffer_t* cb)
 {
-  if(cb->buffer != NULL)
+  if(cb->buffer != NULL && cb->allocator != NULL)
   {
-    free(cb->buffer);
+    io_free(cb->allocator, io_alloc_buffer, cb->buffer, cb->size);
     cb->buffer = NULL;
   }
 }
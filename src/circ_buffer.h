@@ -2,6 +2,7 @@
 #define __CIRC_BUFFER_DEF_H__
 
 #include "common_def.h"
+#include "io_alloc.h"
 
 /**
  * circular buffer structure
@@ -13,9 +14,11 @@ typedef struct
    int         data_size;     /** size of data in buffer          */
    int         begin;         /** buffer begin index              */
    int         end;           /** buffer end index                */
+   io_allocator_t* allocator; /** NULL if memory is given by user */
 } circ_buffer_t;
 
 extern int circ_buffer_init(circ_buffer_t* cb, int size);
+extern int circ_buffer_init_with_allocator(circ_buffer_t* cb, int size, io_allocator_t* a);
 extern void circ_buffer_init_with_mem(circ_buffer_t* cb, uint8_t* buf, int size);
 extern void circ_buffer_deinit(circ_buffer_t* cb);
 extern int circ_buffer_put(circ_buffer_t* cb, uint8_t* buf, int size);
@@ -92,4 +95,31 @@ circ_buffer_is_empty(circ_buffer_t* cb)
    return FALSE;
 }
 
+/*
+ * get free space in circular buffer
+ *
+ * @param cb   circular buffer
+ * @return free space size
+ */
+static inline int
+circ_buffer_get_free_size(circ_buffer_t* cb)
+{
+   return cb->size - cb->data_size;
+}
+
+/*
+ * get the data chunk at the head of circular buffer
+ * that can be accessed without wrap around
+ *
+ * @param cb   circular buffer
+ * @param p    pointer to the beginning of the chunk is returned here
+ * @return size of the chunk
+ */
+static inline int
+circ_buffer_get_linear_data(circ_buffer_t* cb, uint8_t** p)
+{
+   *p = &cb->buffer[cb->begin];
+   return MIN(cb->data_size, cb->size - cb->begin);
+}
+
 #endif //!__CIRC_BUFFER_DEF_H__
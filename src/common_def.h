@@ -6,6 +6,7 @@
 #include <time.h>
 
 #include "generic_list.h"
+#include "io_log.h"
 
 typedef uint8_t bool;
 
@@ -18,6 +19,10 @@ typedef uint8_t bool;
   *__bullshit = 0;              \
 }
 
+#ifndef IO_CACHE_LINE
+#define IO_CACHE_LINE   64
+#endif
+
 #define NARRAY(a)       (sizeof(a)/sizeof(a[0]))
 #define UNUSED(a)       (void)(a)
 
@@ -33,7 +38,4 @@ typedef uint8_t bool;
 #define MIN(a,b)      (a < b ? a : b)
 #define MAX(a,b)      (a > b ? a : b)
 
-#define LOGI(tag, str, ...)       printf("%lu:%s:"str, time(NULL), tag, ##__VA_ARGS__); fflush(stdout)
-#define LOGE(tag, str, ...)       printf("%lu:%s:"str, time(NULL), tag, ##__VA_ARGS__); fflush(stdout)
-
 #endif /* !__COMMON_DEF_H__ */
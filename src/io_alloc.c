@@ -0,0 +1,126 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "io_alloc.h"
+
+static const char* TAG = "io_alloc";
+
+static const char* _sub_names[io_alloc_max] =
+{
+  "core",
+  "buffer",
+  "net",
+  "pipe",
+  "dns",
+  "tls",
+  "app",
+};
+
+static void* io_alloc_libc_alloc(void* arg, size_t size);
+static void io_alloc_libc_free(void* arg, void* p, size_t size);
+
+static io_allocator_t   _libc_allocator =
+{
+  .alloc  = io_alloc_libc_alloc,
+  .free   = io_alloc_libc_free,
+  .arg    = NULL,
+};
+
+static io_allocator_t*  _default = &_libc_allocator;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// libc backend
+//
+///////////////////////////////////////////////////////////////////////////////
+static void*
+io_alloc_libc_alloc(void* arg, size_t size)
+{
+  return malloc(size);
+}
+
+static void
+io_alloc_libc_free(void* arg, void* p, size_t size)
+{
+  free(p);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+///////////////////////////////////////////////////////////////////////////////
+void
+io_allocator_init(io_allocator_t* a, io_alloc_callback alloc, io_free_callback free, void* arg)
+{
+  memset(a, 0, sizeof(io_allocator_t));
+
+  a->alloc  = alloc;
+  a->free   = free;
+  a->arg    = arg;
+}
+
+io_allocator_t*
+io_allocator_default(void)
+{
+  return _default;
+}
+
+//
+// should be set before anything is allocated with the default
+//
+void
+io_allocator_set_default(io_allocator_t* a)
+{
+  _default = a != NULL ? a : &_libc_allocator;
+}
+
+const char*
+io_alloc_sub_name(io_alloc_sub_t sub)
+{
+  return sub < io_alloc_max ? _sub_names[sub] : "unknown";
+}
+
+void*
+io_alloc(io_allocator_t* a, io_alloc_sub_t sub, size_t size)
+{
+  void*   p;
+  size_t  in_use;
+
+  p = a->alloc(a->arg, size);
+  if(p == NULL)
+  {
+    __atomic_add_fetch(&a->failed[sub], 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+
+  in_use = __atomic_add_fetch(&a->in_use[sub], size, __ATOMIC_RELAXED);
+  if(in_use > a->peak[sub])
+  {
+    // racy but only ever off by a concurrent allocation
+    a->peak[sub] = in_use;
+  }
+  return p;
+}
+
+void
+io_free(io_allocator_t* a, io_alloc_sub_t sub, void* p, size_t size)
+{
+  if(p == NULL)
+  {
+    return;
+  }
+
+  __atomic_sub_fetch(&a->in_use[sub], size, __ATOMIC_RELAXED);
+  a->free(a->arg, p, size);
+}
+
+void
+io_allocator_dump(io_allocator_t* a)
+{
+  for(int i = 0; i < io_alloc_max; i++)
+  {
+    LOGI(TAG, "%-8s in use %zu, peak %zu, failed %u\n",
+        io_alloc_sub_name(i), a->in_use[i], a->peak[i], a->failed[i]);
+  }
+}
@@ -0,0 +1,63 @@
+//
+// library wide allocator.
+//
+// every allocation io_driver modules make goes through an io_allocator_t
+// so that it can be backed by an arena, a pool or a static region
+// and bytes can be accounted per subsystem.
+// an io_driver carries the allocator its modules use.
+// anything not tied to a driver uses the default allocator.
+//
+// alloc and free callbacks must be thread safe. TLS handshake offload
+// workers allocate through the allocator of the driver (mbedtls key
+// operations), and blocks may be freed on a thread other than the one
+// that allocated them.
+//
+#ifndef __IO_ALLOC_DEF_H__
+#define __IO_ALLOC_DEF_H__
+
+#include <stddef.h>
+#include "common_def.h"
+
+typedef enum
+{
+  io_alloc_core,          // io_driver and misc
+  io_alloc_buffer,        // circ_buffer
+  io_alloc_net,
+  io_alloc_pipe,
+  io_alloc_dns,
+  io_alloc_tls,           // io_net TLS and mbedtls internals
+  io_alloc_app,           // application objects allocated through the library
+  io_alloc_max,
+} io_alloc_sub_t;
+
+//
+// free gets the size given to alloc. pools don't need to keep it themselves
+//
+typedef void* (*io_alloc_callback)(void* arg, size_t size);
+typedef void (*io_free_callback)(void* arg, void* p, size_t size);
+
+typedef struct
+{
+  io_alloc_callback   alloc;
+  io_free_callback    free;
+  void*               arg;
+
+  //
+  // statistics per subsystem.
+  // updated atomically as offload workers allocate through mbedtls too
+  //
+  size_t              in_use[io_alloc_max];
+  size_t              peak[io_alloc_max];
+  uint32_t            failed[io_alloc_max];
+} io_allocator_t;
+
+extern void io_allocator_init(io_allocator_t* a, io_alloc_callback alloc, io_free_callback free, void* arg);
+extern io_allocator_t* io_allocator_default(void);
+extern void io_allocator_set_default(io_allocator_t* a);
+extern const char* io_alloc_sub_name(io_alloc_sub_t sub);
+extern void io_allocator_dump(io_allocator_t* a);
+
+extern void* io_alloc(io_allocator_t* a, io_alloc_sub_t sub, size_t size);
+extern void io_free(io_allocator_t* a, io_alloc_sub_t sub, void* p, size_t size);
+
+#endif /* !__IO_ALLOC_DEF_H__ */
@@ -1,11 +1,22 @@
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <sys/select.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <time.h>
+#if defined(IO_DRIVER_METRICS)
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
 
 #include "io_driver.h"
+#include "io_static.h"
+#include "io_watchdog.h"
+#include "io_trace.h"
+#include "io_probe.h"
 
 static const char* TAG = "io_driver";
 
@@ -20,18 +31,124 @@ typedef struct
   int         maxfd;
 } select_call_arg_t;
 
-typedef struct
-{
-  struct list_head              le;
-  io_driver_deferred_callback   cb;
-  void*                         arg;
-} deferred_exec_t;
-
 ///////////////////////////////////////////////////////////////////////////////
 //
 // private utilities
 //
 ///////////////////////////////////////////////////////////////////////////////
+#if defined(IO_DRIVER_METRICS)
+static inline uint64_t
+io_driver_now_ns(void)
+{
+  struct timespec   ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint64_t
+io_driver_metrics_callback(io_driver_t* driver, uint64_t started)
+{
+  uint64_t    spent = io_driver_now_ns() - started;
+
+  io_stat_add(&driver->metrics.callback_ns, spent);
+  io_hist_record(&driver->metrics.callback, spent);
+  return spent;
+}
+
+static inline bool
+io_driver_perf_read(io_driver_t* driver, uint64_t v[2])
+{
+  uint64_t    buf[3];     // nr, cycles, cache misses
+
+  if(read(driver->perf_fd[0], buf, sizeof(buf)) != sizeof(buf))
+  {
+    return FALSE;
+  }
+  v[0] = buf[1];
+  v[1] = buf[2];
+  return TRUE;
+}
+
+static inline uint64_t
+io_driver_watcher_enter(io_driver_t* driver, io_driver_watcher_t* watcher)
+{
+  driver->current = watcher->stat;
+
+  if(driver->current != NULL && driver->perf_fd[0] >= 0 &&
+     !io_driver_perf_read(driver, driver->perf_mark))
+  {
+    driver->perf_mark[0] = driver->perf_mark[1] = 0;
+  }
+  return io_driver_now_ns();
+}
+
+//
+// watcher may be gone by now. driver->current is cleared
+// by io_driver_no_watch() in that case
+//
+static inline void
+io_driver_watcher_leave(io_driver_t* driver, uint64_t started)
+{
+  io_driver_watcher_stat_t*   stat = driver->current;
+  uint64_t                    spent = io_driver_metrics_callback(driver, started);
+  uint64_t                    v[2];
+
+  driver->current = NULL;
+  if(stat == NULL)
+  {
+    return;
+  }
+
+  stat->count++;
+  stat->time_ns += spent;
+  if(spent > stat->max_ns)
+  {
+    stat->max_ns = spent;
+  }
+
+  if(driver->perf_fd[0] >= 0 && io_driver_perf_read(driver, v))
+  {
+    stat->cycles       += v[0] - driver->perf_mark[0];
+    stat->cache_misses += v[1] - driver->perf_mark[1];
+  }
+}
+
+static void
+io_driver_metrics_loop(io_driver_t* driver, uint64_t begin, uint64_t poll, uint64_t polled, int events)
+{
+  io_driver_metrics_t*  m = &driver->metrics;
+  uint64_t              busy = (poll - begin) + (io_driver_now_ns() - polled);
+
+  io_stat_add(&m->iterations, 1);
+  io_stat_add(&m->poll_ns, polled - poll);
+  io_stat_add(&m->busy_ns, busy);
+  io_stat_add(&m->events, events);
+  if(events > m->max_events)
+  {
+    io_stat_set(&m->max_events, events);
+  }
+
+  io_hist_record(&m->loop_lag, busy);
+  io_hist_record(&m->events_per_loop, events);
+}
+#endif
+
+static void
+io_driver_watchdog_call(io_driver_t* driver, io_driver_watcher_t* watcher, io_driver_event e)
+{
+  io_watchdog_frame_t   f;
+  const char*           label = NULL;
+
+#if defined(IO_DRIVER_METRICS)
+  label = watcher->stat != NULL ? watcher->stat->label : NULL;
+#endif
+
+  io_watchdog_enter(driver->watchdog, &f, (void*)watcher->callback, label);
+  watcher->callback(watcher, e);
+  io_watchdog_leave(driver->watchdog, &f);
+}
+
 static void
 io_driver_preselect(io_driver_t* driver, select_call_arg_t* s)
 {
@@ -72,7 +189,10 @@ io_driver_preselect(io_driver_t* driver, select_call_arg_t* s)
   }
 }
 
-static void
+//
+// @return number of watcher callbacks called
+//
+static int
 io_driver_postselect(io_driver_t* driver, select_call_arg_t* s)
 {
   //
@@ -99,6 +219,11 @@ io_driver_postselect(io_driver_t* driver, select_call_arg_t* s)
   io_driver_watcher_t*    watcher;
   struct list_head        run_list;
   io_driver_event         e;
+  int                     events = 0,
+                          fd;
+#if defined(IO_DRIVER_METRICS)
+  uint64_t                started;
+#endif
 
   INIT_LIST_HEAD(&run_list);
 
@@ -130,8 +255,73 @@ io_driver_postselect(io_driver_t* driver, select_call_arg_t* s)
 
     if(e != 0x00)
     {
-      watcher->callback(watcher, e);
+      events++;
+      fd = watcher->fd;
+      IO_TRACE(driver, io_trace_dispatch, fd, e, 0);
+      IO_PROBE2(io_driver, dispatch_start, fd, e);
+#if defined(IO_DRIVER_METRICS)
+      started = io_driver_watcher_enter(driver, watcher);
+#endif
+      if(driver->watchdog != NULL)
+      {
+        io_driver_watchdog_call(driver, watcher, e);
+      }
+      else
+      {
+        watcher->callback(watcher, e);
+      }
+#if defined(IO_DRIVER_METRICS)
+      io_driver_watcher_leave(driver, started);
+#endif
+      IO_TRACE(driver, io_trace_dispatch_end, fd, 0, 0);
+      IO_PROBE2(io_driver, dispatch_done, fd, e);
+    }
+  }
+  return events;
+}
+
+static void
+io_driver_run_deferred(io_driver_t* driver)
+{
+  io_driver_deferred_t*   d;
+  struct list_head        run_list;
+  io_watchdog_frame_t     f;
+#if defined(IO_DRIVER_METRICS)
+  uint64_t                started;
+#endif
+
+  //
+  // same trick as postselect.
+  // callbacks re-scheduling themselves get executed at the next loop
+  //
+  INIT_LIST_HEAD(&run_list);
+
+  list_splice_init(&driver->deferred, &run_list);
+
+  while(!list_empty(&run_list))
+  {
+    d = list_first_entry(&run_list, io_driver_deferred_t, le);
+    list_del_init(&d->le);
+
+#if defined(IO_DRIVER_METRICS)
+    io_stat_add(&driver->metrics.deferred, 1);
+    started = io_driver_now_ns();
+#endif
+    IO_TRACE(driver, io_trace_deferred, 0, 0, 0);
+    if(driver->watchdog != NULL)
+    {
+      io_watchdog_enter(driver->watchdog, &f, (void*)d->cb, "deferred");
+      d->cb(d->arg);
+      io_watchdog_leave(driver->watchdog, &f);
+    }
+    else
+    {
+      d->cb(d->arg);
     }
+#if defined(IO_DRIVER_METRICS)
+    io_driver_metrics_callback(driver, started);
+#endif
+    IO_TRACE(driver, io_trace_deferred_end, 0, 0, 0);
   }
 }
 
@@ -144,6 +334,35 @@ void
 io_driver_init(io_driver_t* driver)
 {
   INIT_LIST_HEAD(&driver->watchers);
+  INIT_LIST_HEAD(&driver->deferred);
+
+  // static pools take over default allocator. no-op without IO_DRIVER_STATIC
+  io_static_init();
+
+  driver->loop_count = 0;
+  driver->allocator  = io_allocator_default();
+  driver->watchdog   = NULL;
+  driver->rx_pools   = NULL;
+  driver->net        = NULL;
+#if defined(IO_DRIVER_TRACE)
+  driver->trace      = NULL;
+#endif
+
+#if defined(IO_DRIVER_METRICS)
+  memset(&driver->metrics, 0, sizeof(driver->metrics));
+  INIT_LIST_HEAD(&driver->stats);
+  driver->current = NULL;
+  driver->perf_fd[0] = driver->perf_fd[1] = -1;
+#endif
+}
+
+//
+// call right after io_driver_init() before any module is set up on the driver
+//
+void
+io_driver_set_allocator(io_driver_t* driver, io_allocator_t* a)
+{
+  driver->allocator = a != NULL ? a : io_allocator_default();
 }
 
 void
@@ -152,31 +371,66 @@ io_driver_run(io_driver_t* driver)
   select_call_arg_t       s;
   struct timeval          tv = 
   {
-    .tv_sec   = 1,
+    .tv_sec   = IO_DRIVER_IDLE_SEC,
     .tv_usec  = 0,
   };
-  int                     ret;
+  int                     ret,
+                          events = 0;
+#if defined(IO_DRIVER_METRICS)
+  uint64_t                begin = io_driver_now_ns(),
+                          poll,
+                          polled;
+#endif
+
+  driver->loop_count++;
 
   io_driver_preselect(driver, &s);
 
+  if(!list_empty(&driver->deferred))
+  {
+    tv.tv_sec = 0;
+  }
+
+#if defined(IO_DRIVER_METRICS)
+  poll = io_driver_now_ns();
+#endif
+  IO_TRACE(driver, io_trace_poll_enter, 0, 0, s.maxfd);
+  IO_PROBE1(io_driver, poll_start, s.maxfd);
+
   ret = select(s.maxfd + 1,
                s.rset_empty ? NULL : &s.rset,
                s.wset_empty ? NULL : &s.wset,
                s.eset_empty ? NULL : &s.eset,
                &tv);
 
+#if defined(IO_DRIVER_METRICS)
+  polled = io_driver_now_ns();
+#endif
+  IO_TRACE(driver, io_trace_poll_exit, 0, 0, ret);
+  IO_PROBE1(io_driver, poll_done, ret);
+
   if(ret < 0)
   {
-    LOGE(TAG, "select returned error: %d", ret);
+    // watchdog signal may land here
+    if(errno != EINTR)
+    {
+      LOGE(TAG, "select returned error: %d", ret);
+    }
     return;
   }
 
-  if(ret == 0)
+  if(ret > 0)
   {
-    return;
+    events = io_driver_postselect(driver, &s);
   }
 
-  io_driver_postselect(driver, &s);
+  io_driver_run_deferred(driver);
+
+#if defined(IO_DRIVER_METRICS)
+  io_driver_metrics_loop(driver, begin, poll, polled, events);
+#else
+  UNUSED(events);
+#endif
 }
 
 void
@@ -187,6 +441,9 @@ io_driver_watcher_init(io_driver_watcher_t* watcher, int fd, io_driver_callback
   watcher->fd = fd;
   watcher->event_listening = 0;
   watcher->callback = cb;
+#if defined(IO_DRIVER_METRICS)
+  watcher->stat = NULL;
+#endif
 }
 
 void
@@ -199,6 +456,13 @@ io_driver_watch(io_driver_t* driver, io_driver_watcher_t* watcher, io_driver_eve
   if(old_set == 0 && watcher->event_listening != 0)
   {
     list_add_tail(&watcher->le, &driver->watchers);
+#if defined(IO_DRIVER_METRICS)
+    io_stat_add(&driver->metrics.watchers, 1);
+    if(watcher->stat != NULL)
+    {
+      list_add_tail(&watcher->stat->le, &driver->stats);
+    }
+#endif
   }
 }
 
@@ -212,5 +476,232 @@ io_driver_no_watch(io_driver_t* driver, io_driver_watcher_t* watcher, io_driver_
   if(old_set != 0 && watcher->event_listening == 0)
   {
     list_del_init(&watcher->le);
+#if defined(IO_DRIVER_METRICS)
+    io_stat_add(&driver->metrics.watchers, -1);
+    if(watcher->stat != NULL)
+    {
+      list_del_init(&watcher->stat->le);
+      if(watcher->stat == driver->current)
+      {
+        driver->current = NULL;
+      }
+    }
+#endif
   }
 }
+
+void
+io_driver_deferred_init(io_driver_deferred_t* d, io_driver_deferred_callback cb, void* arg)
+{
+  INIT_LIST_HEAD(&d->le);
+
+  d->cb   = cb;
+  d->arg  = arg;
+}
+
+void
+io_driver_defer(io_driver_t* driver, io_driver_deferred_t* d)
+{
+  if(!list_empty(&d->le))
+  {
+    // already scheduled
+    return;
+  }
+  list_add_tail(&d->le, &driver->deferred);
+}
+
+void
+io_driver_cancel_deferred(io_driver_t* driver, io_driver_deferred_t* d)
+{
+  list_del_init(&d->le);
+}
+
+//
+// lock free copy of driver metrics. no allocation.
+// safe from any thread while the driver is running.
+// @return -1 if built without IO_DRIVER_METRICS
+//
+int
+io_driver_metrics_snapshot(io_driver_t* driver, io_driver_metrics_t* snap)
+{
+#if defined(IO_DRIVER_METRICS)
+  io_driver_metrics_t*  m = &driver->metrics;
+
+  snap->iterations  = io_stat_get(&m->iterations);
+  snap->poll_ns     = io_stat_get(&m->poll_ns);
+  snap->busy_ns     = io_stat_get(&m->busy_ns);
+  snap->callback_ns = io_stat_get(&m->callback_ns);
+  snap->events      = io_stat_get(&m->events);
+  snap->deferred    = io_stat_get(&m->deferred);
+  snap->watchers    = io_stat_get(&m->watchers);
+  snap->max_events  = io_stat_get(&m->max_events);
+
+  io_hist_copy(&snap->loop_lag, &m->loop_lag);
+  io_hist_copy(&snap->callback, &m->callback);
+  io_hist_copy(&snap->events_per_loop, &m->events_per_loop);
+  return 0;
+#else
+  memset(snap, 0, sizeof(io_driver_metrics_t));
+  return -1;
+#endif
+}
+
+void
+io_driver_metrics_dump(io_driver_metrics_t* m)
+{
+  LOGI(TAG, "iterations %llu, watchers %llu, events %llu, deferred %llu, max events/loop %llu\n",
+      (unsigned long long)m->iterations, (unsigned long long)m->watchers,
+      (unsigned long long)m->events, (unsigned long long)m->deferred,
+      (unsigned long long)m->max_events);
+  LOGI(TAG, "poll %llu ms, busy %llu ms, callbacks %llu ms\n",
+      (unsigned long long)(m->poll_ns / 1000000), (unsigned long long)(m->busy_ns / 1000000),
+      (unsigned long long)(m->callback_ns / 1000000));
+  LOGI(TAG, "loop lag usec p50 %llu, p99 %llu, p999 %llu, max %llu\n",
+      (unsigned long long)(io_hist_percentile(&m->loop_lag, 50) / 1000),
+      (unsigned long long)(io_hist_percentile(&m->loop_lag, 99) / 1000),
+      (unsigned long long)(io_hist_percentile(&m->loop_lag, 99.9) / 1000),
+      (unsigned long long)(m->loop_lag.max / 1000));
+  LOGI(TAG, "callback usec p50 %llu, p99 %llu, p999 %llu, max %llu\n",
+      (unsigned long long)(io_hist_percentile(&m->callback, 50) / 1000),
+      (unsigned long long)(io_hist_percentile(&m->callback, 99) / 1000),
+      (unsigned long long)(io_hist_percentile(&m->callback, 99.9) / 1000),
+      (unsigned long long)(m->callback.max / 1000));
+  LOGI(TAG, "events/loop p50 %llu, p99 %llu, mean %llu\n",
+      (unsigned long long)io_hist_percentile(&m->events_per_loop, 50),
+      (unsigned long long)io_hist_percentile(&m->events_per_loop, 99),
+      (unsigned long long)io_hist_mean(&m->events_per_loop));
+}
+
+//
+// attaches stat to watcher for accounting of its callbacks.
+// call after io_driver_watcher_init() and before the watcher is watched.
+// no-op without IO_DRIVER_METRICS
+//
+void
+io_driver_watcher_stat_init(io_driver_watcher_t* watcher, io_driver_watcher_stat_t* stat, const char* label)
+{
+#if defined(IO_DRIVER_METRICS)
+  memset(stat, 0, sizeof(io_driver_watcher_stat_t));
+  strncpy(stat->label, label, IO_DRIVER_STAT_LABEL - 1);
+  INIT_LIST_HEAD(&stat->le);
+
+  watcher->stat = stat;
+#else
+  UNUSED(watcher);
+  UNUSED(stat);
+  UNUSED(label);
+#endif
+}
+
+//
+// copies up to n of the most expensive watchers being watched now
+// into top, most expensive first. call from driver thread.
+// callbacks can call this too. postselect has driver->watchers
+// taken apart then but not driver->stats
+// @return number of entries filled. -1 if built without IO_DRIVER_METRICS
+//
+int
+io_driver_watcher_top(io_driver_t* driver, io_driver_watcher_stat_t* top, int n)
+{
+#if defined(IO_DRIVER_METRICS)
+  io_driver_watcher_stat_t*   stat;
+  int                         filled = 0,
+                              i;
+
+  list_for_each_entry(stat, &driver->stats, le)
+  {
+    for(i = filled; i > 0 && top[i - 1].time_ns < stat->time_ns; i--)
+    {
+      if(i < n)
+      {
+        top[i] = top[i - 1];
+      }
+    }
+
+    if(i < n)
+    {
+      top[i] = *stat;
+      filled = MIN(filled + 1, n);
+    }
+  }
+  return filled;
+#else
+  return -1;
+#endif
+}
+
+//
+// counts cycles and cache misses of watcher callbacks with perf_event_open(2).
+// costs two read() calls per accounted callback.
+// @return -1 if counters are not available
+//
+int
+io_driver_perf_enable(io_driver_t* driver)
+{
+#if defined(IO_DRIVER_METRICS)
+  struct perf_event_attr  attr;
+  int                     leader,
+                          misses;
+
+  if(driver->perf_fd[0] >= 0)
+  {
+    return 0;
+  }
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size           = sizeof(attr);
+  attr.type           = PERF_TYPE_HARDWARE;
+  attr.config         = PERF_COUNT_HW_CPU_CYCLES;
+  attr.read_format    = PERF_FORMAT_GROUP;
+  attr.disabled       = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv     = 1;
+
+  leader = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  if(leader < 0)
+  {
+    LOGE(TAG, "%s perf_event_open failed\n", __func__);
+    return -1;
+  }
+
+  attr.config   = PERF_COUNT_HW_CACHE_MISSES;
+  attr.disabled = 0;
+
+  misses = (int)syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+  if(misses < 0)
+  {
+    LOGE(TAG, "%s perf_event_open failed\n", __func__);
+    close(leader);
+    return -1;
+  }
+
+  ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  driver->perf_fd[0] = leader;
+  driver->perf_fd[1] = misses;
+  return 0;
+#else
+  UNUSED(driver);
+  return -1;
+#endif
+}
+
+//
+// closes counters of io_driver_perf_enable(). accumulated numbers are kept
+//
+void
+io_driver_perf_disable(io_driver_t* driver)
+{
+#if defined(IO_DRIVER_METRICS)
+  if(driver->perf_fd[0] < 0)
+  {
+    return;
+  }
+
+  // group members first. the leader owns the group
+  close(driver->perf_fd[1]);
+  close(driver->perf_fd[0]);
+  driver->perf_fd[0] = driver->perf_fd[1] = -1;
+#else
+  UNUSED(driver);
+#endif
+}
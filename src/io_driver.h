@@ -10,6 +10,8 @@
 #include <stdio.h>
 #include "common_def.h"
 #include "generic_list.h"
+#include "io_alloc.h"
+#include "io_hist.h"
 
 typedef enum
 {
@@ -23,32 +25,135 @@ typedef struct __io_driver_watcher io_driver_watcher_t;
 
 typedef void (*io_driver_callback)(io_driver_watcher_t* watcher, io_driver_event event);
 
+struct __io_watchdog_t;
+struct __io_trace_t;
+
+#define IO_DRIVER_IDLE_SEC        1         // longest select() wait of an idle loop
+
+#define IO_DRIVER_STAT_LABEL      32
+
+//
+// per watcher callback accounting. built in with IO_DRIVER_METRICS.
+// storage belongs to whoever owns the watcher and is attached
+// with io_driver_watcher_stat_init()
+//
+typedef struct
+{
+  char                  label[IO_DRIVER_STAT_LABEL];    // "telnet:10.0.0.5", "io_timer", ...
+  uint64_t              count;
+  uint64_t              time_ns;
+  uint64_t              max_ns;
+  uint64_t              cycles;           // only after io_driver_perf_enable()
+  uint64_t              cache_misses;
+  struct list_head      le;               // in driver->stats while its watcher is watched
+} io_driver_watcher_stat_t;
+
+//
+// list walk in io_driver_run() touches nothing but these.
+// list node first so that the walk lands on the same 32 bytes
+//
 struct __io_driver_watcher
 {
+  struct list_head      le;
+  io_driver_callback    callback;
   int                   fd;
   uint8_t               event_listening;
-  io_driver_callback    callback;
-  struct list_head      le;
+#if defined(IO_DRIVER_METRICS)
+  io_driver_watcher_stat_t* stat;
+#endif
 };
 
 
+//
+// event loop metrics. built in with IO_DRIVER_METRICS (make METRICS=1).
+// times are in nsec. read with io_driver_metrics_snapshot() from any thread
+//
+typedef struct
+{
+  uint64_t              iterations;
+  uint64_t              poll_ns;          // blocked in select()
+  uint64_t              busy_ns;          // everything else
+  uint64_t              callback_ns;      // in watcher and deferred callbacks
+  uint64_t              events;           // watcher callbacks
+  uint64_t              deferred;         // deferred callbacks
+  uint64_t              watchers;         // being watched now
+  uint64_t              max_events;       // most watcher callbacks in one iteration
+
+  io_hist_t             loop_lag;         // busy time per iteration. longest a ready fd waits
+  io_hist_t             callback;         // per watcher or deferred callback
+  io_hist_t             events_per_loop;
+} io_driver_metrics_t;
+
 typedef struct 
 {
   struct list_head      watchers;
+  struct list_head      deferred;
+  uint32_t              loop_count;     // incremented on every io_driver_run()
+  io_allocator_t*       allocator;      // used by modules running on this driver
+  struct __io_watchdog_t* watchdog;     // set by io_watchdog_start()
+  struct __io_net_rx_pools_t* rx_pools; // io_net adaptive rx buffers. set up on first use
+  struct __io_net_state_t*    net;      // io_net memory accounting and counters. set up on first use
+#if defined(IO_DRIVER_TRACE)
+  struct __io_trace_t*  trace;          // set by io_trace_attach()
+#endif
+#if defined(IO_DRIVER_METRICS)
+  io_driver_metrics_t   metrics;
+  struct list_head      stats;          // never spliced away in postselect. see io_driver_watcher_top()
+  io_driver_watcher_stat_t* current;    // of the callback running now. NULL once its watcher is gone
+  int                   perf_fd[2];     // cycles leader and cache misses. -1 if not enabled
+  uint64_t              perf_mark[2];
+#endif
 } io_driver_t;
 
 typedef void (*io_driver_deferred_callback)(void* arg);
 
+//
+// a callback to be executed once at the end of the next loop iteration.
+// while any is scheduled, io_driver_run() polls without blocking.
+//
+typedef struct
+{
+  struct list_head              le;
+  io_driver_deferred_callback   cb;
+  void*                         arg;
+} io_driver_deferred_t;
+
 extern void io_driver_init(io_driver_t* driver);
 extern void io_driver_run(io_driver_t* driver);
 extern void io_driver_watcher_init(io_driver_watcher_t* watcher, int fd, io_driver_callback cb);
 extern void io_driver_watch(io_driver_t* driver, io_driver_watcher_t* watcher, io_driver_event event);
 extern void io_driver_no_watch(io_driver_t* driver, io_driver_watcher_t* watcher, io_driver_event event);
 
+extern void io_driver_set_allocator(io_driver_t* driver, io_allocator_t* a);
+
+extern int io_driver_metrics_snapshot(io_driver_t* driver, io_driver_metrics_t* snap);
+extern void io_driver_metrics_dump(io_driver_metrics_t* m);
+
+extern void io_driver_watcher_stat_init(io_driver_watcher_t* watcher, io_driver_watcher_stat_t* stat, const char* label);
+extern int io_driver_watcher_top(io_driver_t* driver, io_driver_watcher_stat_t* top, int n);
+extern int io_driver_perf_enable(io_driver_t* driver);
+extern void io_driver_perf_disable(io_driver_t* driver);
+
+extern void io_driver_deferred_init(io_driver_deferred_t* d, io_driver_deferred_callback cb, void* arg);
+extern void io_driver_defer(io_driver_t* driver, io_driver_deferred_t* d);
+extern void io_driver_cancel_deferred(io_driver_t* driver, io_driver_deferred_t* d);
+
 static inline void
 io_driver_watcher_set_cb(io_driver_watcher_t* watcher, io_driver_callback cb)
 {
   watcher->callback = cb;
 }
 
+static inline void*
+io_driver_alloc(io_driver_t* driver, io_alloc_sub_t sub, size_t size)
+{
+  return io_alloc(driver->allocator, sub, size);
+}
+
+static inline void
+io_driver_free(io_driver_t* driver, io_alloc_sub_t sub, void* p, size_t size)
+{
+  io_free(driver->allocator, sub, p, size);
+}
+
 #endif /* !__IO_DRIVER_DEF_H__ */
@@ -0,0 +1,76 @@
+#include <string.h>
+
+#include "io_hist.h"
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+///////////////////////////////////////////////////////////////////////////////
+void
+io_hist_init(io_hist_t* h)
+{
+  memset(h, 0, sizeof(io_hist_t));
+}
+
+//
+// for a reader on another thread. counters may move while copying,
+// so a copy taken during recording can be off by the values in flight
+//
+void
+io_hist_copy(io_hist_t* dst, const io_hist_t* src)
+{
+  dst->count  = io_stat_get(&src->count);
+  dst->sum    = io_stat_get(&src->sum);
+  dst->max    = io_stat_get(&src->max);
+
+  for(int i = 0; i < IO_HIST_BUCKETS; i++)
+  {
+    dst->buckets[i] = io_stat_get(&src->buckets[i]);
+  }
+}
+
+uint64_t
+io_hist_bucket_low(int b)
+{
+  int   k;
+
+  if(b < IO_HIST_SUB)
+  {
+    return (uint64_t)b;
+  }
+
+  k = b / IO_HIST_SUB + IO_HIST_SUB_BITS - 1;
+  return (uint64_t)(IO_HIST_SUB + b % IO_HIST_SUB) << (k - IO_HIST_SUB_BITS);
+}
+
+//
+// upper bound of the bucket holding the pct percentile. pct in 0 .. 100
+//
+uint64_t
+io_hist_percentile(const io_hist_t* h, double pct)
+{
+  uint64_t  target,
+            seen = 0;
+
+  if(h->count == 0)
+  {
+    return 0;
+  }
+
+  target = (uint64_t)(h->count * pct / 100.0);
+  if(target == 0)
+  {
+    target = 1;
+  }
+
+  for(int i = 0; i < IO_HIST_BUCKETS - 1; i++)
+  {
+    seen += h->buckets[i];
+    if(seen >= target)
+    {
+      return MIN(io_hist_bucket_low(i + 1) - 1, h->max);
+    }
+  }
+  return h->max;
+}
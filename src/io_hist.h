@@ -0,0 +1,93 @@
+//
+// fixed bucket histogram in HDR style.
+//
+// values are bucketed by power of 2 with IO_HIST_SUB linear sub buckets each,
+// so a bucket is never wider than a quarter of its values. no allocation and
+// recording is a handful of instructions.
+//
+// one thread records. counters are stored with relaxed atomics
+// so that any other thread can read them at any time
+//
+#ifndef __IO_HIST_DEF_H__
+#define __IO_HIST_DEF_H__
+
+#include "common_def.h"
+
+#define IO_HIST_SUB_BITS        2
+#define IO_HIST_SUB             (1 << IO_HIST_SUB_BITS)
+#define IO_HIST_MAX_SHIFT       40        // 2^40 and above go to the last bucket
+#define IO_HIST_BUCKETS         ((IO_HIST_MAX_SHIFT - IO_HIST_SUB_BITS + 1) * IO_HIST_SUB)
+
+typedef struct
+{
+  uint64_t      count;
+  uint64_t      sum;
+  uint64_t      max;
+  uint64_t      buckets[IO_HIST_BUCKETS];
+} io_hist_t;
+
+//
+// single writer statistics. readers see each counter whole
+//
+static inline void
+io_stat_add(uint64_t* p, uint64_t v)
+{
+  __atomic_store_n(p, *p + v, __ATOMIC_RELAXED);
+}
+
+static inline void
+io_stat_set(uint64_t* p, uint64_t v)
+{
+  __atomic_store_n(p, v, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t
+io_stat_get(const uint64_t* p)
+{
+  return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+static inline int
+io_hist_bucket(uint64_t v)
+{
+  int   k;
+
+  if(v < IO_HIST_SUB)
+  {
+    return (int)v;
+  }
+
+  k = 63 - __builtin_clzll(v);
+  if(k >= IO_HIST_MAX_SHIFT)
+  {
+    return IO_HIST_BUCKETS - 1;
+  }
+  return (k - IO_HIST_SUB_BITS + 1) * IO_HIST_SUB + (int)((v >> (k - IO_HIST_SUB_BITS)) & (IO_HIST_SUB - 1));
+}
+
+static inline void
+io_hist_record(io_hist_t* h, uint64_t v)
+{
+  int   b = io_hist_bucket(v);
+
+  io_stat_add(&h->buckets[b], 1);
+  io_stat_add(&h->count, 1);
+  io_stat_add(&h->sum, v);
+  if(v > h->max)
+  {
+    io_stat_set(&h->max, v);
+  }
+}
+
+extern void io_hist_init(io_hist_t* h);
+extern void io_hist_copy(io_hist_t* dst, const io_hist_t* src);
+extern uint64_t io_hist_bucket_low(int b);
+extern uint64_t io_hist_percentile(const io_hist_t* h, double pct);
+
+static inline uint64_t
+io_hist_mean(const io_hist_t* h)
+{
+  return h->count != 0 ? h->sum / h->count : 0;
+}
+
+#endif /* !__IO_HIST_DEF_H__ */
@@ -0,0 +1,499 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+
+#include "io_http_metrics.h"
+
+static const char* TAG = "io_http_metrics";
+
+#define IO_HTTP_METRICS_HDR_RESERVE   160       // status line and headers go right in front of body
+
+static void io_http_metrics_printf(io_http_metrics_conn_t* c, const char* fmt, ...)
+  __attribute__((format(printf, 2, 3)));
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// response body
+//
+///////////////////////////////////////////////////////////////////////////////
+static void
+io_http_metrics_printf(io_http_metrics_conn_t* c, const char* fmt, ...)
+{
+  va_list   ap;
+  int       room = IO_HTTP_METRICS_RESP_SIZE - IO_HTTP_METRICS_HDR_RESERVE - c->body_len,
+            len;
+
+  if(c->overflow)
+  {
+    return;
+  }
+
+  va_start(ap, fmt);
+  len = vsnprintf(&c->resp[IO_HTTP_METRICS_HDR_RESERVE + c->body_len], room, fmt, ap);
+  va_end(ap);
+
+  if(len >= room)
+  {
+    c->overflow = TRUE;
+    return;
+  }
+  c->body_len += len;
+}
+
+static void
+io_http_metrics_prom(io_http_metrics_conn_t* c, const char* name, const char* type,
+    const char* help, uint64_t v)
+{
+  io_http_metrics_printf(c, "# HELP %s %s\n# TYPE %s %s\n%s %llu\n",
+      name, help, name, type, name, (unsigned long long)v);
+}
+
+#if defined(IO_DRIVER_METRICS)
+static void
+io_http_metrics_prom_seconds(io_http_metrics_conn_t* c, const char* name, const char* help, uint64_t ns)
+{
+  io_http_metrics_printf(c, "# HELP %s %s\n# TYPE %s counter\n%s %.9f\n",
+      name, help, name, name, ns / 1e9);
+}
+
+//
+// histogram of nsec as a summary in seconds
+//
+static void
+io_http_metrics_prom_summary(io_http_metrics_conn_t* c, const char* name, const char* help, const io_hist_t* h)
+{
+  static const double   quantiles[] = { 0.5, 0.99, 0.999 };
+
+  io_http_metrics_printf(c, "# HELP %s %s\n# TYPE %s summary\n", name, help, name);
+  for(int i = 0; i < NARRAY(quantiles); i++)
+  {
+    io_http_metrics_printf(c, "%s{quantile=\"%g\"} %.9f\n", name, quantiles[i],
+        io_hist_percentile(h, quantiles[i] * 100) / 1e9);
+  }
+  io_http_metrics_printf(c, "%s_sum %.9f\n%s_count %llu\n", name, h->sum / 1e9,
+      name, (unsigned long long)h->count);
+}
+
+static void
+io_http_metrics_json_hist(io_http_metrics_conn_t* c, const char* name, const io_hist_t* h)
+{
+  io_http_metrics_printf(c, ",\"%s\":{\"count\":%llu,\"mean\":%llu,\"p50\":%llu,\"p99\":%llu,"
+      "\"p999\":%llu,\"max\":%llu}", name,
+      (unsigned long long)h->count,
+      (unsigned long long)io_hist_mean(h),
+      (unsigned long long)io_hist_percentile(h, 50),
+      (unsigned long long)io_hist_percentile(h, 99),
+      (unsigned long long)io_hist_percentile(h, 99.9),
+      (unsigned long long)h->max);
+}
+#endif
+
+static void
+io_http_metrics_build_prom(io_http_metrics_t* m, io_http_metrics_conn_t* c)
+{
+  // never NULL. the metrics listener is on this driver
+  const io_net_stats_t*   ns = io_net_stats(m->driver);
+  const io_net_mem_t*     mem = io_net_mem_stats(m->driver);
+  io_log_stats_t          ls;
+
+  io_http_metrics_prom(c, "io_driver_loops_total", "counter", "Event loop iterations.", m->driver->loop_count);
+
+  io_http_metrics_prom(c, "io_net_connections", "gauge", "Open TCP and TLS connections.", ns->connections);
+  io_http_metrics_prom(c, "io_net_accepts_total", "counter", "Accepted connections.", ns->accepts);
+  io_http_metrics_prom(c, "io_net_connects_total", "counter", "Outgoing connections.", ns->connects);
+  io_http_metrics_prom(c, "io_net_closes_total", "counter", "Closed connections.", ns->closes);
+  io_http_metrics_prom(c, "io_net_rx_bytes_total", "counter", "Payload bytes received.", ns->rx_bytes);
+  io_http_metrics_prom(c, "io_net_tx_bytes_total", "counter", "Payload bytes sent.", ns->tx_bytes);
+  io_http_metrics_prom(c, "io_net_mem_bytes", "gauge", "Bytes held by connections.", mem->total);
+  io_http_metrics_prom(c, "io_net_mem_rejected_total", "counter",
+      "Accepts refused under memory pressure.", mem->rejected);
+
+  if(m->ssl_ctx != NULL)
+  {
+    io_http_metrics_printf(c, "# HELP io_ssl_handshakes_total Completed TLS handshakes.\n"
+        "# TYPE io_ssl_handshakes_total counter\n"
+        "io_ssl_handshakes_total{type=\"full\"} %u\n"
+        "io_ssl_handshakes_total{type=\"resumed\"} %u\n",
+        m->ssl_ctx->full_handshakes, m->ssl_ctx->resumed_handshakes);
+    io_http_metrics_prom(c, "io_ssl_handshakes_active", "gauge", "TLS handshakes in progress.",
+        m->ssl_ctx->hs_active);
+    io_http_metrics_prom(c, "io_ssl_handshakes_queued", "gauge", "TLS handshakes waiting for a slot.",
+        m->ssl_ctx->hs_queued);
+    io_http_metrics_prom(c, "io_ssl_handshakes_rejected_total", "counter",
+        "Connections closed at accept. handshake queue was full.", m->ssl_ctx->hs_rejected);
+  }
+
+  if(m->timer != NULL)
+  {
+    io_http_metrics_prom(c, "io_timer_active", "gauge", "Running timers.", m->timer->st.active);
+    io_http_metrics_prom(c, "io_timer_expired_total", "counter", "Timer callbacks run.", m->timer->st.expired);
+  }
+
+  io_log_get_stats(&ls);
+  io_http_metrics_prom(c, "io_log_dropped_total", "counter", "Log lines dropped.", ls.dropped);
+  io_http_metrics_prom(c, "io_http_metrics_requests_total", "counter", "Requests to this endpoint.", m->requests);
+
+#if defined(IO_DRIVER_METRICS)
+  io_driver_metrics_snapshot(m->driver, &m->snap);
+
+  io_http_metrics_prom_seconds(c, "io_driver_poll_seconds_total", "Time blocked in select.", m->snap.poll_ns);
+  io_http_metrics_prom_seconds(c, "io_driver_busy_seconds_total", "Time out of select.", m->snap.busy_ns);
+  io_http_metrics_prom_seconds(c, "io_driver_callback_seconds_total", "Time in callbacks.", m->snap.callback_ns);
+  io_http_metrics_prom(c, "io_driver_callbacks_total", "counter", "Watcher callbacks.", m->snap.events);
+  io_http_metrics_prom(c, "io_driver_deferred_total", "counter", "Deferred callbacks.", m->snap.deferred);
+  io_http_metrics_prom(c, "io_driver_watchers", "gauge", "Watchers being watched.", m->snap.watchers);
+  io_http_metrics_prom_summary(c, "io_driver_loop_lag_seconds",
+      "Busy time per iteration. longest a ready fd waits.", &m->snap.loop_lag);
+  io_http_metrics_prom_summary(c, "io_driver_callback_duration_seconds",
+      "Time per callback.", &m->snap.callback);
+#endif
+}
+
+static void
+io_http_metrics_build_loop(io_http_metrics_t* m, io_http_metrics_conn_t* c)
+{
+#if defined(IO_DRIVER_METRICS)
+  io_driver_metrics_t*        s = &m->snap;
+  io_driver_watcher_stat_t*   w;
+  char                        label[IO_DRIVER_STAT_LABEL];
+  int                         num;
+
+  io_driver_metrics_snapshot(m->driver, s);
+  num = io_driver_watcher_top(m->driver, m->top, IO_HTTP_METRICS_TOP);
+
+  io_http_metrics_printf(c, "{\"loop_count\":%u,\"metrics\":true,\"iterations\":%llu,"
+      "\"poll_ns\":%llu,\"busy_ns\":%llu,\"callback_ns\":%llu,\"events\":%llu,"
+      "\"deferred\":%llu,\"watchers\":%llu,\"max_events\":%llu",
+      m->driver->loop_count,
+      (unsigned long long)s->iterations, (unsigned long long)s->poll_ns,
+      (unsigned long long)s->busy_ns, (unsigned long long)s->callback_ns,
+      (unsigned long long)s->events, (unsigned long long)s->deferred,
+      (unsigned long long)s->watchers, (unsigned long long)s->max_events);
+
+  io_http_metrics_json_hist(c, "loop_lag_ns", &s->loop_lag);
+  io_http_metrics_json_hist(c, "callback_time_ns", &s->callback);
+  io_http_metrics_json_hist(c, "events_per_loop", &s->events_per_loop);
+
+  io_http_metrics_printf(c, ",\"top\":[");
+  for(int i = 0; i < num; i++)
+  {
+    w = &m->top[i];
+
+    // labels come from applications
+    for(int j = 0; j < IO_DRIVER_STAT_LABEL; j++)
+    {
+      label[j] = (w->label[j] == '"' || w->label[j] == '\\' ||
+                  (w->label[j] > 0 && w->label[j] < 0x20)) ? '_' : w->label[j];
+    }
+    label[IO_DRIVER_STAT_LABEL - 1] = '\0';
+
+    io_http_metrics_printf(c, "%s{\"label\":\"%s\",\"count\":%llu,\"time_ns\":%llu,\"max_ns\":%llu,"
+        "\"cycles\":%llu,\"cache_misses\":%llu}", i == 0 ? "" : ",", label,
+        (unsigned long long)w->count, (unsigned long long)w->time_ns,
+        (unsigned long long)w->max_ns, (unsigned long long)w->cycles,
+        (unsigned long long)w->cache_misses);
+  }
+  io_http_metrics_printf(c, "]}\n");
+#else
+  io_http_metrics_printf(c, "{\"loop_count\":%u,\"metrics\":false}\n", m->driver->loop_count);
+#endif
+}
+
+//
+// status line and headers are put right in front of the body
+//
+static void
+io_http_metrics_respond(io_http_metrics_conn_t* c, int status, const char* reason, const char* type)
+{
+  char    hdr[IO_HTTP_METRICS_HDR_RESERVE];
+  int     len;
+
+  if(c->overflow)
+  {
+    LOGE(TAG, "%s response exceeds %d bytes\n", __func__, IO_HTTP_METRICS_RESP_SIZE);
+
+    c->overflow = FALSE;
+    c->body_len = 0;
+    status      = 500;
+    reason      = "Internal Server Error";
+    type        = "text/plain";
+    io_http_metrics_printf(c, "response buffer too small\n");
+  }
+
+  len = snprintf(hdr, sizeof(hdr), "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %d\r\n%s\r\n",
+      status, reason, type, c->body_len, c->close ? "Connection: close\r\n" : "");
+
+  c->out      = &c->resp[IO_HTTP_METRICS_HDR_RESERVE - len];
+  c->out_len  = len + c->body_len;
+  memcpy(c->out, hdr, len);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// connection handling
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//
+// head is NUL terminated and complete
+//
+static void
+io_http_metrics_handle(io_http_metrics_t* m, io_http_metrics_conn_t* c, char* head)
+{
+  char      method[8],
+            path[128],
+            *p;
+  int       minor;
+
+  c->body_len = 0;
+  c->overflow = FALSE;
+  m->requests++;
+
+  if(sscanf(head, "%7s %127s HTTP/1.%d", method, path, &minor) != 3)
+  {
+    c->close = TRUE;
+    io_http_metrics_respond(c, 400, "Bad Request", "text/plain");
+    return;
+  }
+
+  c->close = minor == 0;
+  for(p = strstr(head, "\r\n"); p != NULL; p = strstr(p, "\r\n"))
+  {
+    p += 2;
+    if(strncasecmp(p, "connection:", 11) == 0)
+    {
+      for(p += 11; *p == ' '; p++)
+        ;
+      c->close = strncasecmp(p, "close", 5) == 0;
+    }
+  }
+
+  p = strchr(path, '?');
+  if(p != NULL)
+  {
+    *p = '\0';
+  }
+
+  if(strcmp(method, "GET") != 0)
+  {
+    io_http_metrics_respond(c, 405, "Method Not Allowed", "text/plain");
+  }
+  else if(strcmp(path, "/metrics") == 0)
+  {
+    io_http_metrics_build_prom(m, c);
+    io_http_metrics_respond(c, 200, "OK", "text/plain; version=0.0.4");
+  }
+  else if(strcmp(path, "/debug/loop") == 0)
+  {
+    io_http_metrics_build_loop(m, c);
+    io_http_metrics_respond(c, 200, "OK", "application/json");
+  }
+  else
+  {
+    io_http_metrics_respond(c, 404, "Not Found", "text/plain");
+  }
+}
+
+static void
+io_http_metrics_close(io_http_metrics_conn_t* c)
+{
+  io_net_close(&c->n);
+  c->in_use = FALSE;
+}
+
+//
+// request head is read in place after what is already buffered.
+// RX is paused while the buffer is full behind a pending response.
+// a connection paused by memory accounting is resumed by io_net only
+//
+static void
+io_http_metrics_rx_buf(io_http_metrics_conn_t* c)
+{
+  int   room = IO_HTTP_METRICS_REQ_SIZE - 1 - c->req_len;
+
+  io_net_set_rx_buf(&c->n, (uint8_t*)&c->req[c->req_len], room);
+  if(room == 0)
+  {
+    io_driver_no_watch(c->n.driver, &c->n.watcher, IO_DRIVER_EVENT_RX);
+  }
+  else if(c->n.mem_paused == 0)
+  {
+    io_driver_watch(c->n.driver, &c->n.watcher, IO_DRIVER_EVENT_RX);
+  }
+}
+
+//
+// @return -1 if connection is closed
+//
+static int
+io_http_metrics_flush(io_http_metrics_conn_t* c)
+{
+  int   ret;
+
+  while(c->out_len > 0)
+  {
+    ret = io_net_tx(&c->n, (uint8_t*)c->out, c->out_len);
+    if(ret == 0)
+    {
+      // tx event resumes
+      return 0;
+    }
+    else if(ret < 0)
+    {
+      io_http_metrics_close(c);
+      return -1;
+    }
+    c->out      += ret;
+    c->out_len  -= ret;
+  }
+
+  if(c->close)
+  {
+    io_http_metrics_close(c);
+    return -1;
+  }
+  return 0;
+}
+
+//
+// answers buffered requests in order until one is incomplete
+// or its response can't be written at once
+//
+static int
+io_http_metrics_serve(io_http_metrics_t* m, io_http_metrics_conn_t* c)
+{
+  char*   end;
+  int     consumed;
+
+  while(c->out_len == 0)
+  {
+    end = strstr(c->req, "\r\n\r\n");
+    if(end == NULL)
+    {
+      if(c->req_len < IO_HTTP_METRICS_REQ_SIZE - 1)
+      {
+        break;
+      }
+      c->close = TRUE;
+      c->body_len = 0;
+      io_http_metrics_respond(c, 431, "Request Header Fields Too Large", "text/plain");
+    }
+    else
+    {
+      end[2]    = '\0';
+      consumed  = end + 4 - c->req;
+
+      io_http_metrics_handle(m, c, c->req);
+
+      c->req_len -= consumed;
+      memmove(c->req, &c->req[consumed], c->req_len + 1);
+    }
+
+    if(io_http_metrics_flush(c) != 0)
+    {
+      return -1;
+    }
+  }
+
+  io_http_metrics_rx_buf(c);
+  return 0;
+}
+
+static io_net_return_t
+io_http_metrics_callback(io_net_t* n, io_net_event_t* e)
+{
+  io_http_metrics_t*      m;
+  io_http_metrics_conn_t* c;
+
+  switch(e->ev)
+  {
+  case io_net_event_enum_alloc_connection:
+    m = container_of(n, io_http_metrics_t, listener);
+    for(int i = 0; i < IO_HTTP_METRICS_CONNS; i++)
+    {
+      c = &m->conns[i];
+      if(!c->in_use)
+      {
+        c->in_use = TRUE;
+        c->m      = m;
+        e->c.n    = &c->n;
+        return io_net_return_continue;
+      }
+    }
+    LOGE(TAG, "%s no free connection\n", __func__);
+    return io_net_return_stop;
+
+  case io_net_event_enum_connected:
+    c = container_of(n, io_http_metrics_conn_t, n);
+    c->req_len  = 0;
+    c->req[0]   = '\0';
+    c->out_len  = 0;
+    c->close    = FALSE;
+    io_net_set_label(n, "http-metrics");
+    io_http_metrics_rx_buf(c);
+    break;
+
+  case io_net_event_enum_rx:
+    c = container_of(n, io_http_metrics_conn_t, n);
+    c->req_len += e->r.len;
+    c->req[c->req_len] = '\0';
+    if(io_http_metrics_serve(c->m, c) != 0)
+    {
+      return io_net_return_stop;
+    }
+    break;
+
+  case io_net_event_enum_tx:
+    c = container_of(n, io_http_metrics_conn_t, n);
+    if(io_http_metrics_flush(c) != 0 || io_http_metrics_serve(c->m, c) != 0)
+    {
+      return io_net_return_stop;
+    }
+    break;
+
+  case io_net_event_enum_closed:
+    c = container_of(n, io_http_metrics_conn_t, n);
+    io_http_metrics_close(c);
+    return io_net_return_stop;
+
+  default:
+    break;
+  }
+  return io_net_return_continue;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+///////////////////////////////////////////////////////////////////////////////
+int
+io_http_metrics_start(io_driver_t* driver, io_http_metrics_t* m, int port)
+{
+  memset(m->conns, 0, sizeof(m->conns));
+
+  m->driver   = driver;
+  m->requests = 0;
+
+  if(io_net_bind(driver, &m->listener, NULL, port, io_http_metrics_callback) != 0)
+  {
+    LOGE(TAG, "%s failed to listen on %d\n", __func__, port);
+    return -1;
+  }
+  io_net_set_label(&m->listener, "listen-http-metrics");
+  return 0;
+}
+
+void
+io_http_metrics_stop(io_http_metrics_t* m)
+{
+  for(int i = 0; i < IO_HTTP_METRICS_CONNS; i++)
+  {
+    if(m->conns[i].in_use)
+    {
+      io_http_metrics_close(&m->conns[i]);
+    }
+  }
+  io_net_close(&m->listener);
+}
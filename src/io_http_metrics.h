@@ -0,0 +1,78 @@
+//
+// minimal HTTP/1.1 responder for scraping library counters.
+//
+//   GET /metrics        Prometheus text format
+//   GET /debug/loop     event loop metrics and busiest watchers as JSON
+//
+// plain TCP only, GET only, keep-alive with pipelined requests served in order.
+// each connection slot builds its responses in its own fixed buffer,
+// so nothing is allocated per request.
+// loop lag, callback times and watchers need IO_DRIVER_METRICS (make METRICS=1)
+//
+#ifndef __IO_HTTP_METRICS_DEF_H__
+#define __IO_HTTP_METRICS_DEF_H__
+
+#include "io_net.h"
+#include "io_timer.h"
+
+#ifndef IO_HTTP_METRICS_CONNS
+#define IO_HTTP_METRICS_CONNS         2         // scrapers served at the same time
+#endif
+
+#ifndef IO_HTTP_METRICS_RESP_SIZE
+#define IO_HTTP_METRICS_RESP_SIZE     8192      // per connection, headers included
+#endif
+
+#define IO_HTTP_METRICS_REQ_SIZE      1024      // request head. longer is 431
+#define IO_HTTP_METRICS_TOP           8         // watchers in /debug/loop
+
+struct __io_http_metrics_t;
+
+typedef struct
+{
+  io_net_t                    n;
+  struct __io_http_metrics_t* m;
+  uint8_t                     in_use;
+  uint8_t                     close;          // after response is out
+  int                         req_len;
+  int                         out_len;        // response not written yet
+  char*                       out;
+  int                         body_len;
+  uint8_t                     overflow;       // body didn't fit
+  char                        req[IO_HTTP_METRICS_REQ_SIZE];
+  char                        resp[IO_HTTP_METRICS_RESP_SIZE];
+} io_http_metrics_conn_t;
+
+typedef struct __io_http_metrics_t
+{
+  io_driver_t*                driver;
+  io_net_t                    listener;
+  io_ssl_ctx_t*               ssl_ctx;        // handshake counters. optional
+  io_timer_t*                 timer;          // timer counters. optional
+  uint64_t                    requests;
+  io_http_metrics_conn_t      conns[IO_HTTP_METRICS_CONNS];
+#if defined(IO_DRIVER_METRICS)
+  io_driver_metrics_t         snap;
+  io_driver_watcher_stat_t    top[IO_HTTP_METRICS_TOP];
+#endif
+} io_http_metrics_t;
+
+extern int io_http_metrics_start(io_driver_t* driver, io_http_metrics_t* m, int port);
+extern void io_http_metrics_stop(io_http_metrics_t* m);
+
+//
+// TLS server context whose handshakes are reported
+//
+static inline void
+io_http_metrics_set_ssl_ctx(io_http_metrics_t* m, io_ssl_ctx_t* ctx)
+{
+  m->ssl_ctx = ctx;
+}
+
+static inline void
+io_http_metrics_set_timer(io_http_metrics_t* m, io_timer_t* t)
+{
+  m->timer = t;
+}
+
+#endif /* !__IO_HTTP_METRICS_DEF_H__ */
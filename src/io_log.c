@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "common_def.h"
+
+//
+// single producer, single consumer.
+// owner thread moves head, flusher moves tail
+//
+typedef struct
+{
+  uint64_t              head;
+  uint64_t              tail;
+  uint64_t              dropped;
+  uint64_t              reported;             // drops already told about
+  char                  records[IO_LOG_RECORDS][IO_LOG_RECORD_SIZE];
+} io_log_ring_t;
+
+static io_log_ring_t              _rings[IO_LOG_MAX_THREADS];
+static int                        _num_rings;
+static __thread io_log_ring_t*    _ring;
+static __thread bool              _no_ring;
+
+static bool                       _started;
+static bool                       _stop;
+static pthread_t                  _flusher;
+static pthread_mutex_t            _drain_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// flusher sleeps here while every ring is empty
+static pthread_mutex_t            _wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t             _wake = PTHREAD_COND_INITIALIZER;
+static bool                       _waiting;
+
+static uint64_t                   _written;
+static uint64_t                   _sync;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// utilities
+//
+///////////////////////////////////////////////////////////////////////////////
+static io_log_ring_t*
+io_log_ring(void)
+{
+  int   ndx;
+
+  if(_ring != NULL || _no_ring)
+  {
+    return _ring;
+  }
+
+  // rings are never given back. a thread keeps its ring until the process exits
+  ndx = __atomic_fetch_add(&_num_rings, 1, __ATOMIC_ACQ_REL);
+  if(ndx >= IO_LOG_MAX_THREADS)
+  {
+    _no_ring = TRUE;
+    return NULL;
+  }
+
+  _ring = &_rings[ndx];
+  return _ring;
+}
+
+static void
+io_log_drain(void)
+{
+  io_log_ring_t*    r;
+  uint64_t          head,
+                    tail,
+                    dropped,
+                    written = 0;
+  int               num;
+
+  pthread_mutex_lock(&_drain_lock);
+
+  num = __atomic_load_n(&_num_rings, __ATOMIC_ACQUIRE);
+  num = MIN(num, IO_LOG_MAX_THREADS);
+
+  for(int i = 0; i < num; i++)
+  {
+    r     = &_rings[i];
+    head  = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+    for(tail = r->tail; tail != head; tail++)
+    {
+      fputs(r->records[tail & (IO_LOG_RECORDS - 1)], stdout);
+      written++;
+    }
+    __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+
+    dropped = __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+    if(dropped != r->reported)
+    {
+      printf("%lu:io_log:%llu lines dropped\n", time(NULL), (unsigned long long)(dropped - r->reported));
+      r->reported = dropped;
+    }
+  }
+
+  if(written != 0)
+  {
+    fflush(stdout);
+    __atomic_add_fetch(&_written, written, __ATOMIC_RELAXED);
+  }
+
+  pthread_mutex_unlock(&_drain_lock);
+}
+
+static bool
+io_log_empty(void)
+{
+  int   num = __atomic_load_n(&_num_rings, __ATOMIC_SEQ_CST);
+
+  num = MIN(num, IO_LOG_MAX_THREADS);
+  for(int i = 0; i < num; i++)
+  {
+    if(__atomic_load_n(&_rings[i].head, __ATOMIC_SEQ_CST) != __atomic_load_n(&_rings[i].tail, __ATOMIC_RELAXED))
+    {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+//
+// _waiting is set before rings are checked and producers check it after
+// publishing a line. one of the two always sees the other
+//
+static void*
+io_log_flusher(void* arg)
+{
+  bool    stop;
+
+  do
+  {
+    io_log_drain();
+
+    pthread_mutex_lock(&_wake_lock);
+    __atomic_store_n(&_waiting, TRUE, __ATOMIC_SEQ_CST);
+    while(!_stop && io_log_empty())
+    {
+      pthread_cond_wait(&_wake, &_wake_lock);
+    }
+    __atomic_store_n(&_waiting, FALSE, __ATOMIC_RELAXED);
+    stop = _stop;
+    pthread_mutex_unlock(&_wake_lock);
+  } while(!stop);
+
+  return NULL;
+}
+
+static void
+io_log_wake(void)
+{
+  pthread_mutex_lock(&_wake_lock);
+  pthread_cond_signal(&_wake);
+  pthread_mutex_unlock(&_wake_lock);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+///////////////////////////////////////////////////////////////////////////////
+void
+io_log(int level, const char* tag, const char* fmt, ...)
+{
+  va_list           ap;
+  io_log_ring_t*    r = NULL;
+  uint64_t          head;
+  char*             rec;
+  int               len;
+
+  if(__atomic_load_n(&_started, __ATOMIC_ACQUIRE))
+  {
+    r = io_log_ring();
+  }
+
+  if(r == NULL)
+  {
+    va_start(ap, fmt);
+    printf("%lu:%s:", time(NULL), tag);
+    vprintf(fmt, ap);
+    fflush(stdout);
+    va_end(ap);
+
+    __atomic_add_fetch(&_sync, 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  head = r->head;
+  if(head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= IO_LOG_RECORDS)
+  {
+    __atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  rec = r->records[head & (IO_LOG_RECORDS - 1)];
+
+  len = snprintf(rec, IO_LOG_RECORD_SIZE, "%lu:%s:", time(NULL), tag);
+  if(len < IO_LOG_RECORD_SIZE)
+  {
+    va_start(ap, fmt);
+    len += vsnprintf(&rec[len], IO_LOG_RECORD_SIZE - len, fmt, ap);
+    va_end(ap);
+  }
+
+  if(len >= IO_LOG_RECORD_SIZE)
+  {
+    // truncated. keep it a line
+    rec[IO_LOG_RECORD_SIZE - 2] = '\n';
+  }
+
+  __atomic_store_n(&r->head, head + 1, __ATOMIC_SEQ_CST);
+
+  if(__atomic_load_n(&_waiting, __ATOMIC_SEQ_CST))
+  {
+    // ring went non-empty while the flusher sleeps. once per burst
+    io_log_wake();
+  }
+}
+
+//
+// call on the io_driver thread. it gets the first ring, ahead of
+// watchdog and offload worker threads started later
+//
+int
+io_log_start(void)
+{
+  if(__atomic_load_n(&_started, __ATOMIC_ACQUIRE))
+  {
+    return 0;
+  }
+
+  io_log_ring();
+
+  _stop = FALSE;
+  if(pthread_create(&_flusher, NULL, io_log_flusher, NULL) != 0)
+  {
+    return -1;
+  }
+
+  __atomic_store_n(&_started, TRUE, __ATOMIC_RELEASE);
+  return 0;
+}
+
+//
+// lines logged after this are written synchronously
+//
+void
+io_log_stop(void)
+{
+  if(!__atomic_load_n(&_started, __ATOMIC_ACQUIRE))
+  {
+    return;
+  }
+
+  __atomic_store_n(&_started, FALSE, __ATOMIC_RELEASE);
+
+  pthread_mutex_lock(&_wake_lock);
+  _stop = TRUE;
+  pthread_cond_signal(&_wake);
+  pthread_mutex_unlock(&_wake_lock);
+  pthread_join(_flusher, NULL);
+
+  io_log_drain();
+}
+
+//
+// writes out everything logged so far. blocks on stdout
+//
+void
+io_log_flush(void)
+{
+  io_log_drain();
+}
+
+void
+io_log_get_stats(io_log_stats_t* stats)
+{
+  int   num = __atomic_load_n(&_num_rings, __ATOMIC_ACQUIRE);
+
+  num = MIN(num, IO_LOG_MAX_THREADS);
+  stats->written  = __atomic_load_n(&_written, __ATOMIC_RELAXED);
+  stats->sync     = __atomic_load_n(&_sync, __ATOMIC_RELAXED);
+  stats->dropped  = 0;
+
+  for(int i = 0; i < num; i++)
+  {
+    stats->dropped += __atomic_load_n(&_rings[i].dropped, __ATOMIC_RELAXED);
+  }
+}
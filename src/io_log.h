@@ -0,0 +1,79 @@
+//
+// asynchronous logger behind LOGE/LOGI/LOGD.
+//
+// a log line is formatted by the calling thread into its own lock free ring
+// and written out by a flusher thread, so a slow stdout (serial console, full pipe)
+// never blocks an io_driver thread. when a ring is full the line is dropped and counted.
+//
+// until io_log_start() is called, and for threads beyond IO_LOG_MAX_THREADS,
+// lines are written synchronously like before. the thread calling io_log_start()
+// always has a ring. others get one on first line, first come first served.
+//
+// levels above IO_LOG_LEVEL are removed at compile time.
+// arguments are still type checked but never evaluated.
+//
+#ifndef __IO_LOG_DEF_H__
+#define __IO_LOG_DEF_H__
+
+#include <stdint.h>
+
+#define IO_LOG_ERROR                0
+#define IO_LOG_INFO                 1
+#define IO_LOG_DEBUG                2
+
+#ifndef IO_LOG_LEVEL
+#define IO_LOG_LEVEL                IO_LOG_INFO
+#endif
+
+#ifndef IO_LOG_MAX_THREADS
+#define IO_LOG_MAX_THREADS          4
+#endif
+
+#ifndef IO_LOG_RECORDS
+#define IO_LOG_RECORDS              128       // per thread. power of 2
+#endif
+
+#define IO_LOG_RECORD_SIZE          128       // longer lines are truncated
+
+typedef struct
+{
+  uint64_t              written;
+  uint64_t              dropped;              // ring full
+  uint64_t              sync;                 // written synchronously
+} io_log_stats_t;
+
+extern void io_log(int level, const char* tag, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+
+extern int io_log_start(void);
+extern void io_log_stop(void);
+extern void io_log_flush(void);
+extern void io_log_get_stats(io_log_stats_t* stats);
+
+#define IO_LOG_ELIDED(level, tag, str, ...)                   \
+  do                                                          \
+  {                                                           \
+    if(0)                                                     \
+    {                                                         \
+      io_log(level, tag, str, ##__VA_ARGS__);                 \
+    }                                                         \
+  } while(0)
+
+#if IO_LOG_LEVEL >= IO_LOG_ERROR
+#define LOGE(tag, str, ...)       io_log(IO_LOG_ERROR, tag, str, ##__VA_ARGS__)
+#else
+#define LOGE(tag, str, ...)       IO_LOG_ELIDED(IO_LOG_ERROR, tag, str, ##__VA_ARGS__)
+#endif
+
+#if IO_LOG_LEVEL >= IO_LOG_INFO
+#define LOGI(tag, str, ...)       io_log(IO_LOG_INFO, tag, str, ##__VA_ARGS__)
+#else
+#define LOGI(tag, str, ...)       IO_LOG_ELIDED(IO_LOG_INFO, tag, str, ##__VA_ARGS__)
+#endif
+
+#if IO_LOG_LEVEL >= IO_LOG_DEBUG
+#define LOGD(tag, str, ...)       io_log(IO_LOG_DEBUG, tag, str, ##__VA_ARGS__)
+#else
+#define LOGD(tag, str, ...)       IO_LOG_ELIDED(IO_LOG_DEBUG, tag, str, ##__VA_ARGS__)
+#endif
+
+#endif /* !__IO_LOG_DEF_H__ */
@@ -1,18 +1,43 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#include <arpa/inet.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <netinet/tcp.h>
+#include <sys/sendfile.h>
+#include <linux/tls.h>
+#include <time.h>
 
 #include "io_net.h"
+#include "io_static.h"
+#include "io_trace.h"
+#include "io_probe.h"
+
+#include "mbedtls/ssl_internal.h"
 
 static const char* TAG  = "io_net";
 static const char* pers = "io_ssl_server";
 
+#if defined(MBEDTLS_SSL_EXPORT_KEYS) && defined(TCP_ULP) && defined(SOL_TLS) && defined(TLS_TX)
+#define IO_SSL_KTLS_SUPPORTED
+#endif
+
+static void io_ssl_rx_more_callback(void* arg);
+static void io_ssl_handshake_callback(io_driver_watcher_t* w, io_driver_event e);
+
+//
+// per driver. everything here is touched by the driver thread only
+//
+typedef struct __io_net_state_t
+{
+  io_net_mem_t      mem;
+  io_net_stats_t    stats;
+} io_net_state_t;
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 // socket related utilities
@@ -31,53 +56,90 @@ sock_util_put_nonblock(int sd)
 // mbedtls utilities
 //
 ///////////////////////////////////////////////////////////////////////////////
-static inline int
-io_ssl_mbedtls_init_server(io_ssl_t* s)
+static int
+io_ssl_ctx_init_common(io_ssl_ctx_t* ctx, int endpoint)
 {
   int ret;
 
-  mbedtls_net_init(&s->mbed_fd);
-  mbedtls_ssl_init(&s->ssl);
-  mbedtls_ssl_config_init(&s->conf);
-  mbedtls_entropy_init(&s->entropy);
-  mbedtls_pk_init(&s->pkey);
-  mbedtls_x509_crt_init(&s->cacert);
-  mbedtls_ctr_drbg_init(&s->ctr_drbg);
-
-  ret = mbedtls_ctr_drbg_seed(&s->ctr_drbg, mbedtls_entropy_func, &s->entropy,
-      (const uint8_t*)pers, strlen(pers));
-  if(ret != 0)
+  mbedtls_ssl_config_init(&ctx->conf);
+  mbedtls_entropy_init(&ctx->entropy);
+  mbedtls_x509_crt_init(&ctx->cacert);
+  for(int i = 0; i < IO_SSL_MAX_CERTS; i++)
   {
-    LOGE(TAG, "failed! mbedtls_ctr_drbg_seed %d\n", ret);
-    return -1;
+    mbedtls_x509_crt_init(&ctx->certs[i].crt);
+    mbedtls_pk_init(&ctx->certs[i].pkey);
+    ctx->certs[i].key_src     = NULL;
+    ctx->certs[i].key_src_len = 0;
+    ctx->certs[i].handshakes  = 0;
   }
-
-  ret = mbedtls_x509_crt_parse( &s->cacert, (const unsigned char *) mbedtls_test_srv_crt,
-      mbedtls_test_srv_crt_len );
-  if(ret != 0)
+  mbedtls_ctr_drbg_init(&ctx->ctr_drbg);
+#if defined(MBEDTLS_SSL_CACHE_C)
+  mbedtls_ssl_cache_init(&ctx->cache);
+#endif
+#if defined(MBEDTLS_SSL_TICKET_C)
+  mbedtls_ssl_ticket_init(&ctx->ticket);
+#endif
+
+  for(int i = 0; i < IO_SSL_CLIENT_SESSIONS; i++)
   {
-    LOGE(TAG, "failed! mbedtls_x509_crt_parse returned %d\n", ret);
-    return -1;
+    ctx->sessions[i].valid = FALSE;
+    mbedtls_ssl_session_init(&ctx->sessions[i].session);
   }
 
-  ret = mbedtls_x509_crt_parse(&s->cacert, (const unsigned char *) mbedtls_test_cas_pem,
-      mbedtls_test_cas_pem_len );
-  if(ret != 0)
+  ctx->endpoint           = endpoint;
+  ctx->session_clock      = 0;
+  ctx->offload            = NULL;
+  ctx->num_workers        = 0;
+  ctx->num_certs          = 0;
+  ctx->ciphersuites       = NULL;
+  ctx->num_ciphersuites   = 0;
+  ctx->full_handshakes    = 0;
+  ctx->resumed_handshakes = 0;
+  ctx->offloaded_ops      = 0;
+  ctx->ktls               = FALSE;
+  ctx->ktls_connections   = 0;
+
+  ctx->hs_max_active      = IO_SSL_HS_MAX_ACTIVE;
+  ctx->hs_max_queued      = IO_SSL_HS_MAX_QUEUED;
+  ctx->hs_budget_us       = IO_SSL_HS_BUDGET_US;
+  ctx->hs_active          = 0;
+  ctx->hs_queued          = 0;
+  ctx->hs_loop            = 0;
+  ctx->hs_spent_us        = 0;
+  ctx->hs_queue_peak      = 0;
+  ctx->hs_waited          = 0;
+  ctx->hs_wait_total_us   = 0;
+  ctx->hs_wait_max_us     = 0;
+  ctx->hs_rejected        = 0;
+  ctx->hs_budget_deferred = 0;
+  ctx->hs_arena_peak      = 0;
+  INIT_LIST_HEAD(&ctx->hs_queue);
+  INIT_LIST_HEAD(&ctx->offload_ops);
+
+  //
+  // mbedtls allocations are routed to io_allocator. must happen before
+  // the first mbedtls allocation. per connection arenas
+  // and static pools need it too
+  //
+  io_static_init();
+
+  if(io_ssl_arena_install() != 0)
   {
-    LOGE(TAG, "failed! mbedtls_x509_crt_parse returned %d\n", ret);
+#if defined(IO_SSL_ARENA) || defined(IO_DRIVER_STATIC)
     return -1;
+#endif
   }
 
-  ret =  mbedtls_pk_parse_key(&s->pkey, (const unsigned char *) mbedtls_test_srv_key,
-      mbedtls_test_srv_key_len, NULL, 0 );
+  ret = mbedtls_ctr_drbg_seed(&ctx->ctr_drbg, mbedtls_entropy_func, &ctx->entropy,
+      (const uint8_t*)pers, strlen(pers));
   if(ret != 0)
   {
-    LOGE(TAG, "failed!  mbedtls_pk_parse_key returned %d\n", ret);
+    LOGE(TAG, "failed! mbedtls_ctr_drbg_seed %d\n", ret);
     return -1;
   }
 
-  ret = mbedtls_ssl_config_defaults(&s->conf,
-      MBEDTLS_SSL_IS_SERVER,
+  ret = mbedtls_ssl_config_defaults(&ctx->conf,
+      endpoint,
       MBEDTLS_SSL_TRANSPORT_STREAM,
       MBEDTLS_SSL_PRESET_DEFAULT);
   if(ret != 0)
@@ -86,156 +148,1885 @@ io_ssl_mbedtls_init_server(io_ssl_t* s)
     return -1;
   }
 
-  mbedtls_ssl_conf_rng(&s->conf, mbedtls_ctr_drbg_random, &s->ctr_drbg);
-  mbedtls_ssl_conf_ca_chain(&s->conf, s->cacert.next, NULL);
+  mbedtls_ssl_conf_rng(&ctx->conf, mbedtls_ctr_drbg_random, &ctx->ctr_drbg);
+  return 0;
+}
 
-  ret = mbedtls_ssl_conf_own_cert(&s->conf, &s->cacert, &s->pkey);
-  if(ret != 0)
+//
+// routes mbedtls allocations of the calling scope into connection arena
+// or, without IO_SSL_ARENA, to the allocator of the connection's driver.
+// NULL s keeps them out of any arena but on the same allocator
+//
+static inline void
+io_ssl_enter_arena(io_ssl_t* s, io_ssl_arena_scope_t* prev)
+{
+  if(s == NULL)
   {
-    LOGE(TAG, "failed!  mbedtls_ssl_conf_own_cert returned %d\n", ret);
-    return -1;
+    io_ssl_arena_enter(prev, NULL, NULL);
+    return;
   }
+#if defined(IO_SSL_ARENA)
+  io_ssl_arena_enter(prev, &s->arena, s->n->driver->allocator);
+#else
+  io_ssl_arena_enter(prev, NULL, s->n->driver->allocator);
+#endif
+}
+
+static inline void
+io_ssl_leave_arena(io_ssl_arena_scope_t* prev)
+{
+  io_ssl_arena_leave(prev);
+}
+
+//
+// per connection setup.
+// everything expensive (DRBG seeding, cert/key parsing) is done once in the shared context.
+//
+static inline int
+io_ssl_mbedtls_init(io_ssl_ctx_t* ctx, io_ssl_t* s)
+{
+  int                  ret;
+  io_ssl_arena_scope_t prev;
+
+  mbedtls_net_init(&s->mbed_fd);
+  mbedtls_ssl_init(&s->ssl);
 
-  ret = mbedtls_ssl_setup(&s->ssl, &s->conf);
+  s->ctx          = ctx;
+  s->mbed_fd.fd   = s->n->sd;
+  s->handshaking  = FALSE;
+  s->resumed      = FALSE;
+  s->ktls_rx      = FALSE;
+  s->ktls_tx      = FALSE;
+  s->ktls_keys    = NULL;
+  s->hs_state     = io_ssl_hs_state_none;
+  s->rec_small    = 0;
+  s->rec_streak   = 0;
+  s->rec_last_tx  = 0;
+
+  INIT_LIST_HEAD(&s->hs_le);
+  circ_buffer_init_with_mem(&s->txq, NULL, 0);
+  io_driver_deferred_init(&s->rx_more, io_ssl_rx_more_callback, s);
+
+#if defined(IO_SSL_ARENA)
+  io_ssl_arena_init(&s->arena, s->n->driver->allocator);
+  s->hs_peak_bytes = 0;
+#endif
+
+  io_ssl_enter_arena(s, &prev);
+  ret = mbedtls_ssl_setup(&s->ssl, &ctx->conf);
   if(ret != 0)
   {
     LOGE(TAG, "mbedtls_ssl_setup failed %d\n", ret);
+    mbedtls_ssl_free(&s->ssl);
+    io_ssl_leave_arena(&prev);
+#if defined(IO_SSL_ARENA)
+    io_ssl_arena_release(&s->arena);
+#endif
     return -1;
   }
+  io_ssl_leave_arena(&prev);
 
-  s->handshaking = FALSE;
-
+  mbedtls_ssl_set_bio(&s->ssl, &s->mbed_fd, mbedtls_net_send, mbedtls_net_recv, NULL);
   return 0;
 }
 
-static inline int
-io_ssl_mbedtls_init_client(io_ssl_t* s)
+//
+// reorders default cipher suites so that those authenticated with ECDSA come first.
+// the client still gets an RSA pair if it doesn't offer any of them
+//
+static int
+io_ssl_ctx_prefer_ecdsa(io_ssl_ctx_t* ctx)
 {
-  int ret;
+  const int*                        list = mbedtls_ssl_list_ciphersuites();
+  const mbedtls_ssl_ciphersuite_t*  info;
+  int                               n = 0,
+                                    ndx = 0;
 
-  mbedtls_net_init(&s->mbed_fd);
-  mbedtls_ssl_init(&s->ssl);
-  mbedtls_ssl_config_init(&s->conf);
-  mbedtls_entropy_init(&s->entropy);
-  mbedtls_pk_init(&s->pkey);
-  mbedtls_x509_crt_init(&s->cacert);
-  mbedtls_ctr_drbg_init(&s->ctr_drbg);
+  while(list[n] != 0)
+  {
+    n++;
+  }
 
-  ret = mbedtls_ctr_drbg_seed(&s->ctr_drbg, mbedtls_entropy_func, &s->entropy,
-      (const uint8_t*)pers, strlen(pers));
-  if(ret != 0)
+  ctx->num_ciphersuites = n + 1;
+  ctx->ciphersuites = io_alloc(io_allocator_default(), io_alloc_tls, sizeof(int) * ctx->num_ciphersuites);
+  if(ctx->ciphersuites == NULL)
   {
-    LOGE(TAG, "failed! mbedtls_ctr_drbg_seed %d\n", ret);
+    LOGE(TAG, "%s out of memory\n", __func__);
     return -1;
   }
 
-  ret = mbedtls_x509_crt_parse(&s->cacert, (const unsigned char *) mbedtls_test_cas_pem,
-      mbedtls_test_cas_pem_len );
-  if(ret != 0)
+  for(int pass = 0; pass < 2; pass++)
   {
-    LOGE(TAG, "failed! mbedtls_x509_crt_parse returned %d\n", ret);
-    return -1;
+    for(int i = 0; i < n; i++)
+    {
+      info = mbedtls_ssl_ciphersuite_from_id(list[i]);
+      if(info == NULL)
+      {
+        continue;
+      }
+
+      if((mbedtls_ssl_get_ciphersuite_sig_pk_alg(info) == MBEDTLS_PK_ECDSA) == (pass == 0))
+      {
+        ctx->ciphersuites[ndx++] = list[i];
+      }
+    }
   }
+  ctx->ciphersuites[ndx] = 0;
 
-  ret = mbedtls_ssl_config_defaults(&s->conf,
-      MBEDTLS_SSL_IS_CLIENT,
-      MBEDTLS_SSL_TRANSPORT_STREAM,
-      MBEDTLS_SSL_PRESET_DEFAULT);
-  if(ret != 0)
+  mbedtls_ssl_conf_ciphersuites(&ctx->conf, ctx->ciphersuites);
+  return 0;
+}
+
+//
+// counts the full handshake against the pair serving it
+//
+static void
+io_ssl_cert_account(io_ssl_t* s)
+{
+  const mbedtls_ssl_ciphersuite_t*  info;
+  mbedtls_pk_type_t                 alg;
+
+  info = mbedtls_ssl_ciphersuite_from_string(mbedtls_ssl_get_ciphersuite(&s->ssl));
+  if(info == NULL)
   {
-    LOGE(TAG, "failed! mbedtls_ssl_config_defaults %d\n", ret);
-    return -1;
+    return;
   }
 
-  mbedtls_ssl_conf_authmode(&s->conf, MBEDTLS_SSL_VERIFY_NONE);
-  mbedtls_ssl_conf_ca_chain(&s->conf, &s->cacert, NULL );
-  mbedtls_ssl_conf_rng(&s->conf, mbedtls_ctr_drbg_random, &s->ctr_drbg );
+  alg = mbedtls_ssl_get_ciphersuite_sig_pk_alg(info);
 
-  ret = mbedtls_ssl_setup(&s->ssl, &s->conf);
-  if(ret != 0)
+  for(int i = 0; i < s->ctx->num_certs; i++)
   {
-    LOGE(TAG, "mbedtls_ssl_setup failed %d\n", ret);
-    return -1;
+    if(mbedtls_pk_can_do(&s->ctx->certs[i].pkey, alg))
+    {
+      s->ctx->certs[i].handshakes++;
+      return;
+    }
   }
+}
 
-  mbedtls_ssl_set_bio(&s->ssl, &s->mbed_fd, mbedtls_net_send, mbedtls_net_recv, NULL);
+#if defined(MBEDTLS_SSL_CACHE_C)
+//
+// cache entries outlive the connection. keep them out of its arena
+//
+static int
+io_ssl_cache_get(void* data, mbedtls_ssl_session* session)
+{
+  io_ssl_arena_scope_t prev;
+  int                  ret;
+
+  io_ssl_enter_arena(NULL, &prev);
+  ret = mbedtls_ssl_cache_get(data, session);
+  io_ssl_leave_arena(&prev);
+  return ret;
+}
+
+static int
+io_ssl_cache_set(void* data, const mbedtls_ssl_session* session)
+{
+  io_ssl_arena_scope_t prev;
+  int                  ret;
+
+  io_ssl_enter_arena(NULL, &prev);
+  ret = mbedtls_ssl_cache_set(data, session);
+  io_ssl_leave_arena(&prev);
+  return ret;
+}
+#endif
+
+static int
+io_ssl_ctx_init_resumption(io_ssl_ctx_t* ctx)
+{
+#if defined(MBEDTLS_SSL_CACHE_C)
+  mbedtls_ssl_cache_set_max_entries(&ctx->cache, IO_SSL_SESSION_CACHE_SIZE);
+  mbedtls_ssl_cache_set_timeout(&ctx->cache, IO_SSL_SESSION_TIMEOUT);
+  mbedtls_ssl_conf_session_cache(&ctx->conf, &ctx->cache,
+      io_ssl_cache_get, io_ssl_cache_set);
+#endif
+
+#if defined(MBEDTLS_SSL_TICKET_C)
+  {
+    int ret;
+
+    //
+    // ticket module keeps two keys and rotates them every lifetime period
+    //
+    ret = mbedtls_ssl_ticket_setup(&ctx->ticket, mbedtls_ctr_drbg_random, &ctx->ctr_drbg,
+        MBEDTLS_CIPHER_AES_256_GCM, IO_SSL_TICKET_LIFETIME);
+    if(ret != 0)
+    {
+      LOGE(TAG, "failed! mbedtls_ssl_ticket_setup returned %d\n", ret);
+      return -1;
+    }
 
-  s->handshaking = FALSE;
+    mbedtls_ssl_conf_session_tickets_cb(&ctx->conf,
+        mbedtls_ssl_ticket_write, mbedtls_ssl_ticket_parse, &ctx->ticket);
+  }
+#endif
   return 0;
 }
 
-static inline int
-io_ssl_mbedtls_init_accepted(io_ssl_t* l, io_ssl_t* s)
+//
+// client side per endpoint session store.
+// returns the matching entry or NULL. with alloc, the least recently used entry is recycled
+//
+static io_ssl_client_session_t*
+io_ssl_client_session_find(io_ssl_ctx_t* ctx, in_addr_t addr, uint16_t port, bool alloc)
 {
-  int ret;
+  io_ssl_client_session_t*    victim = &ctx->sessions[0];
+  io_ssl_client_session_t*    e;
 
-  mbedtls_net_init(&s->mbed_fd);
-  mbedtls_ssl_init(&s->ssl);
-  mbedtls_ssl_config_init(&s->conf);
-  mbedtls_entropy_init(&s->entropy);
-  mbedtls_pk_init(&s->pkey);
-  mbedtls_x509_crt_init(&s->cacert);
-  mbedtls_ctr_drbg_init(&s->ctr_drbg);
+  for(int i = 0; i < IO_SSL_CLIENT_SESSIONS; i++)
+  {
+    e = &ctx->sessions[i];
 
-  s->mbed_fd.fd = s->n->sd;
+    if(e->valid && e->addr == addr && e->port == port)
+    {
+      e->last_used = ++ctx->session_clock;
+      return e;
+    }
 
-  ret = mbedtls_ctr_drbg_seed(&s->ctr_drbg, mbedtls_entropy_func, &s->entropy,
-      (const uint8_t*)pers, strlen(pers));
-  if(ret != 0)
+    if(!e->valid || (victim->valid && e->last_used < victim->last_used))
+    {
+      victim = e;
+    }
+  }
+
+  if(!alloc)
   {
-    LOGE(TAG, "mbedtls_ctr_drbg_reseed failed %d\n", ret);
-    return -1;
+    return NULL;
   }
 
-  ret = mbedtls_ssl_setup(&s->ssl, &l->conf);
-  if(ret != 0)
+  mbedtls_ssl_session_free(&victim->session);
+  mbedtls_ssl_session_init(&victim->session);
+
+  victim->addr      = addr;
+  victim->port      = port;
+  victim->valid     = FALSE;
+  victim->last_used = ++ctx->session_clock;
+  return victim;
+}
+
+static void
+io_ssl_client_session_load(io_ssl_t* s)
+{
+  io_ssl_client_session_t*    e;
+  io_ssl_arena_scope_t        prev;
+
+  e = io_ssl_client_session_find(s->ctx, s->peer_addr, s->peer_port, FALSE);
+  if(e == NULL)
   {
-    LOGE(TAG, "mbedtls_ssl_setup failed %d\n", ret);
-    return -1;
+    return;
   }
 
-  mbedtls_ssl_set_bio(&s->ssl, &s->mbed_fd, mbedtls_net_send, mbedtls_net_recv, NULL);
+  io_ssl_enter_arena(s, &prev);
+  if(mbedtls_ssl_set_session(&s->ssl, &e->session) != 0)
+  {
+    LOGE(TAG, "%s mbedtls_ssl_set_session failed\n", __func__);
+  }
+  io_ssl_leave_arena(&prev);
+}
 
-  s->handshaking = FALSE;
-  return 0;
+static void
+io_ssl_client_session_save(io_ssl_t* s)
+{
+  io_ssl_client_session_t*    e;
+  io_ssl_arena_scope_t        prev;
+  int                         ret;
+
+  e = io_ssl_client_session_find(s->ctx, s->peer_addr, s->peer_port, TRUE);
+
+  // the copy belongs to context. not to connection arena
+  io_ssl_enter_arena(NULL, &prev);
+
+  mbedtls_ssl_session_free(&e->session);
+  mbedtls_ssl_session_init(&e->session);
+
+  ret = mbedtls_ssl_get_session(&s->ssl, &e->session);
+  io_ssl_leave_arena(&prev);
+
+  if(ret != 0)
+  {
+    LOGE(TAG, "%s mbedtls_ssl_get_session failed\n", __func__);
+    return;
+  }
+  e->valid = TRUE;
 }
 
-static inline void
-io_ssl_mbedtls_deinit(io_ssl_t* s)
+//
+// key export callback has no connection argument.
+// per thread as every io_driver thread runs its own handshakes
+//
+static __thread io_ssl_t*   _handshaking;
+
+//
+// mbedtls_ssl_handshake() equivalent.
+// stepped manually to find out whether the session is being resumed
+// since handshake parameters are gone once the handshake is over.
+//
+static int
+io_ssl_mbedtls_handshake(io_ssl_t* s)
 {
-  mbedtls_net_free(&s->mbed_fd);
-  mbedtls_x509_crt_free(&s->cacert);
-  mbedtls_pk_free(&s->pkey);
-  mbedtls_ssl_free(&s->ssl);
-  mbedtls_ssl_config_free(&s->conf);
-  mbedtls_ctr_drbg_free(&s->ctr_drbg);
-  mbedtls_entropy_free(&s->entropy);
+  int                  ret = 0;
+  io_ssl_arena_scope_t prev;
+
+  _handshaking = s;
+  io_ssl_enter_arena(s, &prev);
+
+  while(s->ssl.state != MBEDTLS_SSL_HANDSHAKE_OVER)
+  {
+    if(s->ssl.handshake != NULL && s->ssl.handshake->resume)
+    {
+      s->resumed = TRUE;
+    }
+
+    ret = mbedtls_ssl_handshake_step(&s->ssl);
+    IO_TRACE(s->n->driver, io_trace_hs_step, s->n->sd, s->ssl.state, -ret);
+    IO_PROBE3(io_net, hs_step, s->n->sd, s->ssl.state, ret);
+    if(ret != 0)
+    {
+      break;
+    }
+  }
+
+  io_ssl_leave_arena(&prev);
+  _handshaking = NULL;
+
+#if defined(IO_SSL_ARENA)
+  if(s->arena.peak > s->hs_peak_bytes)
+  {
+    s->hs_peak_bytes = (uint32_t)s->arena.peak;
+  }
+#endif
+  return ret;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 //
-// utilities
+// handshake admission control
 //
 ///////////////////////////////////////////////////////////////////////////////
-static io_net_return_t
-io_net_handle_data_rx_event(io_net_t* n)
+static inline uint64_t
+io_ssl_now_us(void)
 {
-  int             ret;
-  io_net_event_t  ev;
+  struct timespec   ts;
 
-  ret = read(n->sd, n->rx_buf, n->rx_size);
-  if(ret <= 0)
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static inline bool
+io_ssl_hs_queue_full(io_ssl_ctx_t* ctx)
+{
+  return ctx->hs_max_active != 0 && ctx->hs_active >= ctx->hs_max_active &&
+         ctx->hs_max_queued != 0 && ctx->hs_queued >= ctx->hs_max_queued;
+}
+
+static void
+io_ssl_hs_activate(io_ssl_t* s)
+{
+  s->hs_state = io_ssl_hs_state_active;
+  s->ctx->hs_active++;
+
+  // ClientHello is already waiting in socket
+  io_driver_watch(s->n->driver, &s->n->watcher, IO_DRIVER_EVENT_RX);
+}
+
+//
+// newly accepted connection either gets a slot or waits in queue
+//
+static void
+io_ssl_hs_enter(io_ssl_t* s)
+{
+  io_ssl_ctx_t*   ctx = s->ctx;
+
+  if(ctx->hs_max_active == 0 || ctx->hs_active < ctx->hs_max_active)
   {
-    ev.ev = io_net_event_enum_closed;
+    io_ssl_hs_activate(s);
+    return;
   }
-  else
+
+  s->hs_state     = io_ssl_hs_state_queued;
+  s->hs_queued_at = io_ssl_now_us();
+
+  list_add_tail(&s->hs_le, &ctx->hs_queue);
+  ctx->hs_queued++;
+
+  if(ctx->hs_queued > ctx->hs_queue_peak)
   {
-    ev.ev = io_net_event_enum_rx;
-    ev.r.buf = n->rx_buf;
-    ev.r.len = (uint32_t)ret;
+    ctx->hs_queue_peak = ctx->hs_queued;
   }
+}
 
-  return n->cb(n, &ev);
+static void
+io_ssl_hs_admit(io_ssl_ctx_t* ctx)
+{
+  io_ssl_t*   s;
+  uint64_t    waited;
+
+  while(!list_empty(&ctx->hs_queue) &&
+        (ctx->hs_max_active == 0 || ctx->hs_active < ctx->hs_max_active))
+  {
+    s = list_first_entry(&ctx->hs_queue, io_ssl_t, hs_le);
+    list_del_init(&s->hs_le);
+    ctx->hs_queued--;
+
+    waited = io_ssl_now_us() - s->hs_queued_at;
+
+    ctx->hs_waited++;
+    ctx->hs_wait_total_us += waited;
+    if(waited > ctx->hs_wait_max_us)
+    {
+      ctx->hs_wait_max_us = (uint32_t)waited;
+    }
+
+    io_ssl_hs_activate(s);
+  }
+}
+
+//
+// gives back the slot or the queue entry. safe to call more than once
+//
+static void
+io_ssl_hs_leave(io_ssl_t* s)
+{
+  io_ssl_ctx_t*   ctx = s->ctx;
+
+  switch(s->hs_state)
+  {
+  case io_ssl_hs_state_queued:
+    list_del_init(&s->hs_le);
+    ctx->hs_queued--;
+    break;
+
+  case io_ssl_hs_state_active:
+    ctx->hs_active--;
+    io_ssl_hs_admit(ctx);
+    break;
+
+  default:
+    break;
+  }
+  s->hs_state = io_ssl_hs_state_none;
+}
+
+//
+// at least one handshake step is taken per loop iteration
+// no matter how long a single step takes
+//
+static inline bool
+io_ssl_hs_budget_exhausted(io_ssl_t* s)
+{
+  io_ssl_ctx_t*   ctx = s->ctx;
+
+  return ctx->hs_budget_us != 0 &&
+         ctx->hs_loop == s->n->driver->loop_count &&
+         ctx->hs_spent_us >= ctx->hs_budget_us;
+}
+
+static inline void
+io_ssl_hs_charge(io_ssl_t* s, uint64_t spent)
+{
+  io_ssl_ctx_t*   ctx = s->ctx;
+
+  if(ctx->hs_loop != s->n->driver->loop_count)
+  {
+    ctx->hs_loop      = s->n->driver->loop_count;
+    ctx->hs_spent_us  = 0;
+  }
+  ctx->hs_spent_us += (uint32_t)spent;
+}
+
+#if defined(IO_SSL_KTLS_SUPPORTED)
+///////////////////////////////////////////////////////////////////////////////
+//
+// kernel TLS offload
+//
+// once the handshake is over, AES-GCM TLS 1.2 keys and sequence numbers are
+// handed to the kernel and the connection takes the plain read/write path.
+// anything not supported by the kernel or mbedtls build just stays in mbedtls.
+//
+///////////////////////////////////////////////////////////////////////////////
+struct __io_ssl_ktls_keys_t
+{
+  uint8_t     keylen;
+  uint8_t     client_key[32];
+  uint8_t     server_key[32];
+  uint8_t     client_salt[4];
+  uint8_t     server_salt[4];
+};
+
+static int
+io_ssl_ktls_export_keys(void* p_expkey, const unsigned char* ms, const unsigned char* kb,
+    size_t maclen, size_t keylen, size_t ivlen,
+    const unsigned char client_random[32], const unsigned char server_random[32],
+    mbedtls_tls_prf_types tls_prf_type)
+{
+  io_ssl_t*             s = _handshaking;
+  io_ssl_ktls_keys_t*   k;
+
+  // keys of some other context. not ours to take
+  if(s == NULL || s->ctx != p_expkey)
+  {
+    return 0;
+  }
+
+  //
+  // key block : client MAC, server MAC, client key, server key, client IV, server IV
+  // only AEAD with 4 byte implicit IV (GCM) is applicable
+  //
+  if(maclen != 0 || ivlen != 4 || (keylen != 16 && keylen != 32))
+  {
+    return 0;
+  }
+
+  if(s->ktls_keys == NULL)
+  {
+    s->ktls_keys = io_driver_alloc(s->n->driver, io_alloc_tls, sizeof(io_ssl_ktls_keys_t));
+    if(s->ktls_keys == NULL)
+    {
+      return 0;
+    }
+  }
+
+  k = s->ktls_keys;
+
+  k->keylen = (uint8_t)keylen;
+  memcpy(k->client_key,   &kb[0],                   keylen);
+  memcpy(k->server_key,   &kb[keylen],              keylen);
+  memcpy(k->client_salt,  &kb[2 * keylen],          ivlen);
+  memcpy(k->server_salt,  &kb[2 * keylen + ivlen],  ivlen);
+
+  return 0;
+}
+
+static int
+io_ssl_ktls_set(int sd, int dir, uint8_t keylen,
+    const uint8_t* key, const uint8_t* salt, const uint8_t* seq)
+{
+  struct tls12_crypto_info_aes_gcm_128    ci128;
+  struct tls12_crypto_info_aes_gcm_256    ci256;
+
+  //
+  // mbedtls uses the record sequence number as explicit nonce.
+  // so does the kernel with iv initialized to the sequence number
+  //
+  if(keylen == 16)
+  {
+    memset(&ci128, 0, sizeof(ci128));
+    ci128.info.version      = TLS_1_2_VERSION;
+    ci128.info.cipher_type  = TLS_CIPHER_AES_GCM_128;
+    memcpy(ci128.key,     key,  TLS_CIPHER_AES_GCM_128_KEY_SIZE);
+    memcpy(ci128.salt,    salt, TLS_CIPHER_AES_GCM_128_SALT_SIZE);
+    memcpy(ci128.iv,      seq,  TLS_CIPHER_AES_GCM_128_IV_SIZE);
+    memcpy(ci128.rec_seq, seq,  TLS_CIPHER_AES_GCM_128_REC_SEQ_SIZE);
+
+    return setsockopt(sd, SOL_TLS, dir, &ci128, sizeof(ci128));
+  }
+
+  memset(&ci256, 0, sizeof(ci256));
+  ci256.info.version      = TLS_1_2_VERSION;
+  ci256.info.cipher_type  = TLS_CIPHER_AES_GCM_256;
+  memcpy(ci256.key,     key,  TLS_CIPHER_AES_GCM_256_KEY_SIZE);
+  memcpy(ci256.salt,    salt, TLS_CIPHER_AES_GCM_256_SALT_SIZE);
+  memcpy(ci256.iv,      seq,  TLS_CIPHER_AES_GCM_256_IV_SIZE);
+  memcpy(ci256.rec_seq, seq,  TLS_CIPHER_AES_GCM_256_REC_SEQ_SIZE);
+
+  return setsockopt(sd, SOL_TLS, dir, &ci256, sizeof(ci256));
+}
+
+static void
+io_ssl_ktls_start(io_ssl_t* s)
+{
+  io_ssl_ktls_keys_t*   k = s->ktls_keys;
+  const char*           suite;
+  bool                  server;
+  int                   sd = s->n->sd;
+
+  s->ktls_keys = NULL;
+
+  if(k == NULL)
+  {
+    return;
+  }
+
+  suite = mbedtls_ssl_get_ciphersuite(&s->ssl);
+  if(s->ssl.minor_ver != MBEDTLS_SSL_MINOR_VERSION_3 ||
+     suite == NULL || strstr(suite, "-AES-") == NULL || strstr(suite, "-GCM-") == NULL)
+  {
+    LOGI(TAG, "kTLS not applicable to %s\n", suite ? suite : "unknown");
+    goto out;
+  }
+
+  //
+  // nothing must be left inside mbedtls in either direction
+  //
+  if(s->ssl.in_left != 0 || mbedtls_ssl_get_bytes_avail(&s->ssl) != 0 || s->ssl.out_left != 0)
+  {
+    LOGI(TAG, "kTLS skipped. mbedtls has pending records\n");
+    goto out;
+  }
+
+  if(setsockopt(sd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) != 0)
+  {
+    LOGI(TAG, "kTLS not available in kernel %d\n", errno);
+    goto out;
+  }
+
+  server = s->ctx->endpoint == MBEDTLS_SSL_IS_SERVER;
+
+  //
+  // RX first. if TX fails after that, mbedtls keeps encrypting
+  // and plain writes of its records are still fine
+  //
+  if(io_ssl_ktls_set(sd, TLS_RX, k->keylen,
+        server ? k->client_key : k->server_key,
+        server ? k->client_salt : k->server_salt,
+        s->ssl.in_ctr) != 0)
+  {
+    LOGI(TAG, "kTLS RX setup failed %d\n", errno);
+    goto out;
+  }
+  s->ktls_rx = TRUE;
+
+  if(io_ssl_ktls_set(sd, TLS_TX, k->keylen,
+        server ? k->server_key : k->client_key,
+        server ? k->server_salt : k->client_salt,
+        s->ssl.cur_out_ctr) != 0)
+  {
+    LOGI(TAG, "kTLS TX setup failed %d\n", errno);
+    goto out;
+  }
+  s->ktls_tx = TRUE;
+
+  s->ctx->ktls_connections++;
+  LOGI(TAG, "kTLS enabled with %s\n", suite);
+
+out:
+  memset(k, 0, sizeof(io_ssl_ktls_keys_t));
+  io_driver_free(s->n->driver, io_alloc_tls, k, sizeof(io_ssl_ktls_keys_t));
+}
+#endif /* IO_SSL_KTLS_SUPPORTED */
+
+#if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
+///////////////////////////////////////////////////////////////////////////////
+//
+// handshake private key offload
+//
+// mbedtls is not thread safe on a shared key (RSA blinding, EC precomputation)
+// nor on a shared DRBG. every worker keeps its own DRBG and key copy
+// in its slot of the context, so contexts sharing a pool don't evict
+// each other's keys and the copies go away with the context.
+//
+///////////////////////////////////////////////////////////////////////////////
+typedef enum
+{
+  io_ssl_async_sign,
+  io_ssl_async_decrypt,
+} io_ssl_async_type_t;
+
+typedef struct
+{
+  io_offload_job_t        job;
+
+  // set on io_driver thread
+  io_allocator_t*         allocator;
+  io_ssl_ctx_t*           ctx;
+  struct list_head        ctx_le;       // in ctx->offload_ops until done
+  io_ssl_t*               s;            // NULL once cancelled
+  uint8_t                 completed;
+  int                     cert;         // index of ctx->certs
+
+  // set before submit and read by worker
+  io_ssl_async_type_t     type;
+  mbedtls_md_type_t       md_alg;
+  uint8_t                 input[MBEDTLS_PK_SIGNATURE_MAX_SIZE];
+  size_t                  input_len;
+
+  // set by worker
+  int                     ret;
+  uint8_t                 output[MBEDTLS_PK_SIGNATURE_MAX_SIZE];
+  size_t                  output_len;
+} io_ssl_async_op_t;
+
+//
+// touched only by the worker owning the slot while the context is alive.
+// allocated and freed on io_driver thread
+//
+typedef struct __io_ssl_worker_t
+{
+  bool                      seeded;
+  mbedtls_entropy_context   entropy;
+  mbedtls_ctr_drbg_context  ctr_drbg;
+  mbedtls_pk_context        pkey[IO_SSL_MAX_CERTS];
+  bool                      parsed[IO_SSL_MAX_CERTS];
+} io_ssl_worker_t;
+
+static io_ssl_worker_t*
+io_ssl_worker_alloc(io_driver_t* driver)
+{
+  io_ssl_worker_t*    w;
+
+  w = io_driver_alloc(driver, io_alloc_tls, sizeof(io_ssl_worker_t));
+  if(w == NULL)
+  {
+    return NULL;
+  }
+
+  w->seeded = FALSE;
+  mbedtls_entropy_init(&w->entropy);
+  mbedtls_ctr_drbg_init(&w->ctr_drbg);
+  for(int i = 0; i < IO_SSL_MAX_CERTS; i++)
+  {
+    mbedtls_pk_init(&w->pkey[i]);
+    w->parsed[i] = FALSE;
+  }
+  return w;
+}
+
+static void
+io_ssl_worker_free(io_driver_t* driver, io_ssl_worker_t* w)
+{
+  for(int i = 0; i < IO_SSL_MAX_CERTS; i++)
+  {
+    mbedtls_pk_free(&w->pkey[i]);
+  }
+  mbedtls_ctr_drbg_free(&w->ctr_drbg);
+  mbedtls_entropy_free(&w->entropy);
+
+  io_driver_free(driver, io_alloc_tls, w, sizeof(io_ssl_worker_t));
+}
+
+static mbedtls_pk_context*
+io_ssl_worker_get_key(io_ssl_worker_t* w, io_ssl_ctx_t* ctx, int cert)
+{
+  io_ssl_cert_t*      c = &ctx->certs[cert];
+
+  if(!w->seeded)
+  {
+    if(mbedtls_ctr_drbg_seed(&w->ctr_drbg, mbedtls_entropy_func, &w->entropy,
+          (const uint8_t*)pers, strlen(pers)) != 0)
+    {
+      return NULL;
+    }
+    w->seeded = TRUE;
+  }
+
+  if(!w->parsed[cert])
+  {
+    if(mbedtls_pk_parse_key(&w->pkey[cert], c->key_src, c->key_src_len, NULL, 0) != 0)
+    {
+      return NULL;
+    }
+    w->parsed[cert] = TRUE;
+  }
+  return &w->pkey[cert];
+}
+
+static void
+io_ssl_async_work(io_offload_job_t* job)
+{
+  io_ssl_async_op_t*    op = container_of(job, io_ssl_async_op_t, job);
+  io_ssl_worker_t*      w  = op->ctx->workers[job->worker];
+  mbedtls_pk_context*   pkey;
+  io_ssl_arena_scope_t  prev;
+
+  // key copies and mbedtls scratch memory on the allocator of the driver
+  io_ssl_arena_enter(&prev, NULL, op->allocator);
+
+  pkey = io_ssl_worker_get_key(w, op->ctx, op->cert);
+  if(pkey == NULL)
+  {
+    op->ret = MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    io_ssl_arena_leave(&prev);
+    return;
+  }
+
+  if(op->type == io_ssl_async_sign)
+  {
+    op->ret = mbedtls_pk_sign(pkey, op->md_alg, op->input, op->input_len,
+        op->output, &op->output_len, mbedtls_ctr_drbg_random, &w->ctr_drbg);
+  }
+  else
+  {
+    op->ret = mbedtls_pk_decrypt(pkey, op->input, op->input_len,
+        op->output, &op->output_len, sizeof(op->output),
+        mbedtls_ctr_drbg_random, &w->ctr_drbg);
+  }
+  io_ssl_arena_leave(&prev);
+}
+
+static void
+io_ssl_async_done(io_offload_job_t* job)
+{
+  io_ssl_async_op_t*    op = container_of(job, io_ssl_async_op_t, job);
+
+  list_del_init(&op->ctx_le);
+
+  if(op->s == NULL)
+  {
+    // connection is gone
+    io_free(op->allocator, io_alloc_tls, op, sizeof(io_ssl_async_op_t));
+    return;
+  }
+
+  op->completed = TRUE;
+
+  // let mbedtls pick up the result through io_ssl_async_resume()
+  io_ssl_handshake_callback(&op->s->n->watcher, 0);
+}
+
+static int
+io_ssl_async_start(mbedtls_ssl_context* ssl, mbedtls_x509_crt* crt, io_ssl_async_type_t type,
+    mbedtls_md_type_t md_alg, const unsigned char* input, size_t input_len)
+{
+  io_ssl_ctx_t*         ctx = mbedtls_ssl_conf_get_async_config_data(ssl->conf);
+  io_ssl_t*             s   = container_of(ssl, io_ssl_t, ssl);
+  io_ssl_async_op_t*    op;
+  int                   cert;
+
+  if(input_len > MBEDTLS_PK_SIGNATURE_MAX_SIZE)
+  {
+    return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+  }
+
+  // mbedtls hands back the certificate it picked. find the key behind it
+  for(cert = 0; cert < ctx->num_certs; cert++)
+  {
+    if(&ctx->certs[cert].crt == crt)
+    {
+      break;
+    }
+  }
+
+  if(cert == ctx->num_certs)
+  {
+    return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+  }
+
+  op = io_driver_alloc(s->n->driver, io_alloc_tls, sizeof(io_ssl_async_op_t));
+  if(op == NULL)
+  {
+    return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+  }
+
+  io_offload_job_init(&op->job, io_ssl_async_work, io_ssl_async_done);
+
+  op->allocator   = s->n->driver->allocator;
+  op->ctx         = ctx;
+  op->s           = s;
+  op->completed   = FALSE;
+  op->cert        = cert;
+  op->type        = type;
+  op->md_alg      = md_alg;
+  op->input_len   = input_len;
+  op->output_len  = 0;
+  op->ret         = 0;
+  memcpy(op->input, input, input_len);
+
+  mbedtls_ssl_set_async_operation_data(ssl, op);
+
+  list_add_tail(&op->ctx_le, &ctx->offload_ops);
+  ctx->offloaded_ops++;
+  io_offload_submit(ctx->offload, &op->job);
+
+  return MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS;
+}
+
+static int
+io_ssl_async_sign_start(mbedtls_ssl_context* ssl, mbedtls_x509_crt* cert,
+    mbedtls_md_type_t md_alg, const unsigned char* hash, size_t hash_len)
+{
+  return io_ssl_async_start(ssl, cert, io_ssl_async_sign, md_alg, hash, hash_len);
+}
+
+static int
+io_ssl_async_decrypt_start(mbedtls_ssl_context* ssl, mbedtls_x509_crt* cert,
+    const unsigned char* input, size_t input_len)
+{
+  return io_ssl_async_start(ssl, cert, io_ssl_async_decrypt, MBEDTLS_MD_NONE, input, input_len);
+}
+
+static int
+io_ssl_async_resume(mbedtls_ssl_context* ssl, unsigned char* output, size_t* output_len,
+    size_t output_size)
+{
+  io_ssl_async_op_t*    op = mbedtls_ssl_get_async_operation_data(ssl);
+  int                   ret;
+
+  if(!op->completed)
+  {
+    return MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS;
+  }
+
+  ret = op->ret;
+  if(ret == 0)
+  {
+    if(op->output_len > output_size)
+    {
+      ret = MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+    else
+    {
+      memcpy(output, op->output, op->output_len);
+      *output_len = op->output_len;
+    }
+  }
+
+  mbedtls_ssl_set_async_operation_data(ssl, NULL);
+  io_free(op->allocator, io_alloc_tls, op, sizeof(io_ssl_async_op_t));
+  return ret;
+}
+
+static void
+io_ssl_async_cancel(mbedtls_ssl_context* ssl)
+{
+  io_ssl_async_op_t*    op = mbedtls_ssl_get_async_operation_data(ssl);
+
+  if(op == NULL)
+  {
+    return;
+  }
+
+  mbedtls_ssl_set_async_operation_data(ssl, NULL);
+
+  if(op->completed)
+  {
+    io_free(op->allocator, io_alloc_tls, op, sizeof(io_ssl_async_op_t));
+    return;
+  }
+
+  // still running on a worker. freed in io_ssl_async_done()
+  op->s = NULL;
+}
+
+//
+// takes back every operation of ctx from the pool and frees worker slots.
+// connections of ctx are all gone by now
+//
+static void
+io_ssl_ctx_offload_deinit(io_ssl_ctx_t* ctx)
+{
+  io_ssl_async_op_t*    op;
+
+  while(!list_empty(&ctx->offload_ops))
+  {
+    op = list_first_entry(&ctx->offload_ops, io_ssl_async_op_t, ctx_le);
+    list_del_init(&op->ctx_le);
+
+    io_offload_cancel(ctx->offload, &op->job);
+    io_free(op->allocator, io_alloc_tls, op, sizeof(io_ssl_async_op_t));
+  }
+
+  for(int i = 0; i < ctx->num_workers; i++)
+  {
+    io_ssl_worker_free(ctx->offload->driver, ctx->workers[i]);
+    ctx->workers[i] = NULL;
+  }
+  ctx->num_workers  = 0;
+  ctx->offload      = NULL;
+}
+#endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
+
+static inline void
+io_ssl_mbedtls_deinit(io_ssl_t* s)
+{
+  io_ssl_arena_scope_t prev;
+
+  if(s->ktls_keys != NULL)
+  {
+    memset(s->ktls_keys, 0, sizeof(*s->ktls_keys));
+    io_driver_free(s->n->driver, io_alloc_tls, s->ktls_keys, sizeof(*s->ktls_keys));
+    s->ktls_keys = NULL;
+  }
+
+  //
+  // mbed_fd is not freed with mbedtls_net_free() here
+  // since the socket is owned and closed by io_net
+  //
+  io_ssl_enter_arena(s, &prev);
+  mbedtls_ssl_free(&s->ssl);
+  io_ssl_leave_arena(&prev);
+
+#if defined(IO_SSL_ARENA)
+  io_ssl_arena_release(&s->arena);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// adaptive rx buffers
+//
+///////////////////////////////////////////////////////////////////////////////
+#define IO_NET_RX_CLASS_SIZE(cls)   (1 << ((cls) + IO_NET_RX_MIN_SHIFT))
+
+typedef struct
+{
+  void*       free_list;      // linked through the first word
+  uint32_t    cached;
+
+  // statistics
+  uint32_t    in_use;
+  uint32_t    peak;
+} io_net_rx_pool_t;
+
+//
+// one per io_driver. buffers come from the allocator of the driver
+//
+typedef struct __io_net_rx_pools_t
+{
+  io_net_rx_pool_t    pools[IO_NET_RX_CLASSES];
+
+  // statistics
+  uint32_t            grows;
+  uint32_t            shrinks;
+} io_net_rx_pools_t;
+
+static inline int
+io_net_rx_class(int size)
+{
+  int   cls = 0;
+
+  while(cls < IO_NET_RX_CLASSES - 1 && IO_NET_RX_CLASS_SIZE(cls) < size)
+  {
+    cls++;
+  }
+  return cls;
+}
+
+static io_net_rx_pools_t*
+io_net_rx_pools(io_driver_t* driver)
+{
+  if(driver->rx_pools == NULL)
+  {
+    driver->rx_pools = io_driver_alloc(driver, io_alloc_net, sizeof(io_net_rx_pools_t));
+    if(driver->rx_pools != NULL)
+    {
+      memset(driver->rx_pools, 0, sizeof(io_net_rx_pools_t));
+    }
+  }
+  return driver->rx_pools;
+}
+
+static uint8_t*
+io_net_rx_get(io_driver_t* driver, int cls)
+{
+  io_net_rx_pools_t*  pools = io_net_rx_pools(driver);
+  io_net_rx_pool_t*   p;
+  uint8_t*            b;
+
+  if(pools == NULL)
+  {
+    return NULL;
+  }
+  p = &pools->pools[cls];
+
+  if(p->free_list != NULL)
+  {
+    b = p->free_list;
+    p->free_list = *(void**)b;
+    p->cached--;
+  }
+  else
+  {
+    b = io_driver_alloc(driver, io_alloc_net, IO_NET_RX_CLASS_SIZE(cls));
+    if(b == NULL)
+    {
+      return NULL;
+    }
+  }
+
+  p->in_use++;
+  p->peak = MAX(p->peak, p->in_use);
+  return b;
+}
+
+//
+// b came from io_net_rx_get() so the pools are there
+//
+static void
+io_net_rx_put(io_driver_t* driver, int cls, uint8_t* b)
+{
+  io_net_rx_pool_t*   p = &driver->rx_pools->pools[cls];
+
+  p->in_use--;
+
+  if(p->cached < IO_NET_RX_POOL_CACHE)
+  {
+    *(void**)b = p->free_list;
+    p->free_list = b;
+    p->cached++;
+    return;
+  }
+  io_driver_free(driver, io_alloc_net, b, IO_NET_RX_CLASS_SIZE(cls));
+}
+
+//
+// gives cached buffers back to the allocator
+//
+static void
+io_net_rx_pool_trim(io_driver_t* driver)
+{
+  io_net_rx_pool_t*   p;
+  void*               b;
+
+  if(driver->rx_pools == NULL)
+  {
+    return;
+  }
+
+  for(int cls = 0; cls < IO_NET_RX_CLASSES; cls++)
+  {
+    p = &driver->rx_pools->pools[cls];
+
+    while(p->free_list != NULL)
+    {
+      b = p->free_list;
+      p->free_list = *(void**)b;
+      io_driver_free(driver, io_alloc_net, b, IO_NET_RX_CLASS_SIZE(cls));
+    }
+    p->cached = 0;
+  }
+}
+
+static void
+io_net_rx_resize(io_net_t* n, int cls)
+{
+  uint8_t*    b;
+
+  if(cls == n->rx_cls)
+  {
+    return;
+  }
+
+  b = io_net_rx_get(n->driver, cls);
+  if(b == NULL)
+  {
+    // keep going with what we have
+    return;
+  }
+  io_net_rx_put(n->driver, n->rx_cls, n->rx_buf);
+
+  if(cls > n->rx_cls)
+  {
+    n->driver->rx_pools->grows++;
+  }
+  else
+  {
+    n->driver->rx_pools->shrinks++;
+  }
+
+  n->rx_buf     = b;
+  n->rx_size    = IO_NET_RX_CLASS_SIZE(cls);
+  n->rx_cls     = cls;
+  n->rx_filled  = FALSE;
+  n->rx_small   = 0;
+
+  io_net_mem_update(n);
+}
+
+//
+// called right before reading. the application owns rx_buf until
+// its callback returns, so decisions are made on what earlier reads saw
+//
+static void
+io_net_rx_adapt(io_net_t* n)
+{
+  int   avail = 0;
+
+  if(!n->rx_adaptive)
+  {
+    return;
+  }
+
+  if(n->rx_filled)
+  {
+    // more was likely waiting. ask how much
+    if(ioctl(n->sd, FIONREAD, &avail) != 0)
+    {
+      avail = 0;
+    }
+
+    if(n->ssl != NULL && !n->ssl->ktls_rx)
+    {
+      avail += mbedtls_ssl_get_bytes_avail(&n->ssl->ssl);
+    }
+
+    if(avail > n->rx_size && n->rx_cls < n->rx_max_cls)
+    {
+      io_net_rx_resize(n, MIN(io_net_rx_class(avail), n->rx_max_cls));
+    }
+  }
+  else if(n->rx_small >= IO_NET_RX_SHRINK_READS && n->rx_cls > n->rx_min_cls)
+  {
+    io_net_rx_resize(n, n->rx_cls - 1);
+  }
+}
+
+static inline void
+io_net_rx_account(io_net_t* n, int len)
+{
+  if(len > 0)
+  {
+    n->driver->net->stats.rx_bytes += len;
+  }
+
+  if(!n->rx_adaptive || len <= 0)
+  {
+    // errors and TLS want-read say nothing about traffic
+    return;
+  }
+
+  n->rx_filled = len >= n->rx_size;
+
+  if(len < n->rx_size / 4)
+  {
+    n->rx_small = MIN(n->rx_small + 1, IO_NET_RX_SHRINK_READS);
+  }
+  else
+  {
+    n->rx_small = 0;
+  }
+}
+
+static void
+io_net_rx_release(io_net_t* n)
+{
+  if(!n->rx_adaptive)
+  {
+    return;
+  }
+
+  io_net_rx_put(n->driver, n->rx_cls, n->rx_buf);
+
+  n->rx_adaptive  = FALSE;
+  n->rx_buf       = NULL;
+  n->rx_size      = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// utilities
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//
+// default watcher stat label. "kind:addr:port" or "kind:port" without addr.
+// addr and port in network byte order
+//
+static void
+io_net_stat_init(io_net_t* n, const char* kind, uint32_t addr, uint16_t port)
+{
+#if defined(IO_DRIVER_METRICS)
+  char              label[IO_DRIVER_STAT_LABEL];
+  struct in_addr    a;
+
+  a.s_addr = addr;
+  if(addr != 0)
+  {
+    snprintf(label, sizeof(label), "%s:%s:%d", kind, inet_ntoa(a), ntohs(port));
+  }
+  else
+  {
+    snprintf(label, sizeof(label), "%s:%d", kind, ntohs(port));
+  }
+  io_driver_watcher_stat_init(&n->watcher, &n->stat, label);
+#else
+  UNUSED(n);
+  UNUSED(kind);
+  UNUSED(addr);
+  UNUSED(port);
+#endif
+}
+
+static io_net_return_t
+io_net_handle_data_rx_event(io_net_t* n)
+{
+  int             ret;
+  io_net_event_t  ev;
+
+  io_net_rx_adapt(n);
+
+  ret = read(n->sd, n->rx_buf, n->rx_size);
+  if(ret < 0 && (errno == EWOULDBLOCK || errno == EAGAIN))
+  {
+    // kTLS socket is readable before a whole record is in
+    return io_net_return_continue;
+  }
+  io_net_rx_account(n, ret);
+  IO_TRACE(n->driver, io_trace_rx, n->sd, 0, MAX(ret, 0));
+  IO_PROBE2(io_net, rx, n->sd, ret);
+
+  if(ret <= 0)
+  {
+    ev.ev = io_net_event_enum_closed;
+  }
+  else
+  {
+    ev.ev = io_net_event_enum_rx;
+    ev.r.buf = n->rx_buf;
+    ev.r.len = (uint32_t)ret;
+  }
+
+  return n->cb(n, &ev);
+}
+
+//
+// small record size is derived from MSS once the record expansion
+// of the negotiated cipher suite is known
+//
+static void
+io_ssl_record_size_init(io_ssl_t* s)
+{
+  int         mss,
+              expansion;
+  socklen_t   len = sizeof(mss);
+
+  s->rec_small  = 0;
+  s->rec_streak = 0;
+
+  if(IO_SSL_REC_GROW_BYTES == 0)
+  {
+    return;
+  }
+
+  if(getsockopt(s->n->sd, IPPROTO_TCP, TCP_MAXSEG, &mss, &len) != 0 || mss <= 0)
+  {
+    mss = IO_SSL_REC_MSS_DEFAULT;
+  }
+
+  expansion = mbedtls_ssl_get_record_expansion(&s->ssl);
+  if(expansion < 0 || mss - expansion < 512)
+  {
+    return;
+  }
+
+  s->rec_small = (uint16_t)(mss - expansion);
+}
+
+static int
+io_ssl_record_size(io_ssl_t* s, int max_payload)
+{
+  uint64_t  now = io_ssl_now_us();
+
+  if(now - s->rec_last_tx > IO_SSL_REC_IDLE_MS * 1000)
+  {
+    // congestion window is likely to be back to small too
+    s->rec_streak = 0;
+  }
+  s->rec_last_tx = now;
+
+  if(s->rec_small == 0 || s->rec_streak >= IO_SSL_REC_GROW_BYTES)
+  {
+    return max_payload;
+  }
+  return MIN(max_payload, s->rec_small);
+}
+
+//
+// hands as much of buf as possible to mbedtls, one record at a time.
+// a record that could not be sent completely stays in mbedtls output buffer
+// and counts as written. it is flushed by io_ssl_tx_flush() on TX readiness.
+//
+// @return bytes consumed, -1 on error
+//
+static int
+io_ssl_write_records(io_ssl_t* s, uint8_t* buf, int len)
+{
+  int                  nwritten = 0,
+                       max_payload,
+                       chunk,
+                       ret;
+  io_ssl_arena_scope_t prev;
+
+  max_payload = mbedtls_ssl_get_max_out_record_payload(&s->ssl);
+  if(max_payload <= 0)
+  {
+    return -1;
+  }
+  max_payload = io_ssl_record_size(s, max_payload);
+
+  while(nwritten < len && s->ssl.out_left == 0)
+  {
+    chunk = MIN(len - nwritten, max_payload);
+
+    io_ssl_enter_arena(s, &prev);
+    ret = mbedtls_ssl_write(&s->ssl, &buf[nwritten], chunk);
+    io_ssl_leave_arena(&prev);
+
+    if(ret > 0)
+    {
+      nwritten += ret;
+    }
+    else if(ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+    {
+      // record is already encrypted. only sending is pending
+      nwritten += chunk;
+    }
+    else
+    {
+      LOGE(TAG, "%s mbedtls_ssl_write failed %x\n", __func__, -ret);
+      return -1;
+    }
+  }
+
+  // only compared against IO_SSL_REC_GROW_BYTES. must not wrap on long streams
+  s->rec_streak = MIN(s->rec_streak + nwritten, IO_SSL_REC_GROW_BYTES);
+  return nwritten;
+}
+
+static int
+io_ssl_tx_enqueue(io_ssl_t* s, uint8_t* buf, int len)
+{
+  len = MIN(len, circ_buffer_get_free_size(&s->txq));
+  if(len > 0)
+  {
+    circ_buffer_put(&s->txq, buf, len);
+  }
+  return len;
+}
+
+//
+// retries the pending record and then the queued plain text
+//
+// @return
+//      1, if everything is sent
+//      0, if still waiting for TX readiness
+//     -1, if error
+//
+static int
+io_ssl_tx_flush(io_ssl_t* s)
+{
+  uint8_t*             p;
+  int                  len,
+                       ret;
+  io_ssl_arena_scope_t prev;
+
+  io_ssl_enter_arena(s, &prev);
+  ret = mbedtls_ssl_flush_output(&s->ssl);
+  io_ssl_leave_arena(&prev);
+
+  if(ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+  {
+    return 0;
+  }
+  else if(ret != 0)
+  {
+    LOGE(TAG, "%s mbedtls_ssl_flush_output failed %x\n", __func__, -ret);
+    return -1;
+  }
+
+  while(!circ_buffer_is_empty(&s->txq))
+  {
+    len = circ_buffer_get_linear_data(&s->txq, &p);
+
+    ret = io_ssl_write_records(s, p, len);
+    if(ret < 0)
+    {
+      return -1;
+    }
+    circ_buffer_advance(&s->txq, ret);
+
+    if(s->ssl.out_left != 0)
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// memory accounting
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// TLS state of a connection when no arena measures it. record buffers dominate
+#define IO_SSL_MEM_ESTIMATE       (MBEDTLS_SSL_IN_BUFFER_LEN + MBEDTLS_SSL_OUT_BUFFER_LEN)
+
+static void io_net_mem_shed(void* arg);
+
+//
+// set up by io_net_bind()/io_net_connect().
+// accepted connections share the state of their listener
+//
+static io_net_state_t*
+io_net_state(io_driver_t* driver)
+{
+  io_net_state_t*   st;
+
+  if(driver->net != NULL)
+  {
+    return driver->net;
+  }
+
+  st = io_driver_alloc(driver, io_alloc_net, sizeof(io_net_state_t));
+  if(st == NULL)
+  {
+    return NULL;
+  }
+  memset(st, 0, sizeof(io_net_state_t));
+
+  st->mem.conn_limit    = IO_NET_MEM_CONN_LIMIT;
+  st->mem.global_limit  = IO_NET_MEM_GLOBAL_LIMIT;
+  INIT_LIST_HEAD(&st->mem.conns);
+  INIT_LIST_HEAD(&st->mem.shed.le);
+  st->mem.shed.cb       = io_net_mem_shed;
+  st->mem.shed.arg      = &st->mem;
+
+  driver->net = st;
+  return st;
+}
+
+static inline uint32_t
+io_net_mem_measure(io_net_t* n)
+{
+  uint32_t    held = n->rx_size + n->mem_app;
+  io_ssl_t*   s = n->ssl;
+
+  if(s != NULL)
+  {
+    held += s->txq.size;
+#if defined(IO_SSL_ARENA)
+    held += s->arena.in_use;
+#else
+    held += IO_SSL_MEM_ESTIMATE;
+#endif
+  }
+  return held;
+}
+
+//
+// nothing queued for the peer. whatever the application holds for it
+// can be given back and set up again when traffic comes
+//
+static inline bool
+io_net_mem_idle(io_net_t* n)
+{
+  io_ssl_t*   s = n->ssl;
+
+  if(n->mem_paused != 0)
+  {
+    return FALSE;
+  }
+
+  if(s != NULL && (s->handshaking || s->ssl.out_left != 0 || !circ_buffer_is_empty(&s->txq)))
+  {
+    return FALSE;
+  }
+  return TRUE;
+}
+
+//
+// pausing and resuming are silent.
+// the application is told from io_net_mem_shed() outside of any callback
+//
+static void
+io_net_mem_pause(io_net_t* n, uint8_t why)
+{
+  if(n->mem_paused == 0)
+  {
+    io_driver_no_watch(n->driver, &n->watcher, IO_DRIVER_EVENT_RX);
+    if(n->ssl != NULL)
+    {
+      io_driver_cancel_deferred(n->driver, &n->ssl->rx_more);
+    }
+
+    n->driver->net->mem.paused++;
+    io_driver_defer(n->driver, &n->driver->net->mem.shed);
+  }
+  n->mem_paused |= why;
+}
+
+static void
+io_net_mem_resume(io_net_t* n, uint8_t why)
+{
+  io_ssl_t*   s = n->ssl;
+
+  if(!(n->mem_paused & why))
+  {
+    return;
+  }
+
+  n->mem_paused &= ~why;
+  if(n->mem_paused != 0)
+  {
+    return;
+  }
+
+  io_driver_watch(n->driver, &n->watcher, IO_DRIVER_EVENT_RX);
+  if(s != NULL && !s->ktls_rx && mbedtls_ssl_get_bytes_avail(&s->ssl) != 0)
+  {
+    // select() can't see plain text already decrypted
+    io_driver_defer(n->driver, &s->rx_more);
+  }
+  io_driver_defer(n->driver, &n->driver->net->mem.shed);
+}
+
+static void
+io_net_mem_check_global(io_driver_t* driver)
+{
+  io_net_mem_t*   m = &driver->net->mem;
+
+  if(!m->pressure && m->global_limit != 0 && m->total >= m->global_limit)
+  {
+    LOGI(TAG, "memory pressure. %llu bytes held\n", (unsigned long long)m->total);
+    m->pressure     = TRUE;
+    m->pressure_new = TRUE;
+    m->pressure_events++;
+    io_driver_defer(driver, &m->shed);
+  }
+  else if(m->pressure &&
+          (m->global_limit == 0 || m->total <= m->global_limit * IO_NET_MEM_LOW_PCT / 100))
+  {
+    LOGI(TAG, "memory pressure over. %llu bytes held\n", (unsigned long long)m->total);
+    m->pressure     = FALSE;
+    m->pressure_new = FALSE;
+    io_driver_defer(driver, &m->shed);
+  }
+}
+
+//
+// every io_net_t gets this on setup. only connections are attached
+//
+static inline void
+io_net_mem_init(io_net_t* n)
+{
+  INIT_LIST_HEAD(&n->mem_le);
+
+  n->mem_held     = 0;
+  n->mem_app      = 0;
+  n->mem_paused   = 0;
+  n->mem_reported = FALSE;
+
+  // rx buffer is accounted. its mode starts here too
+  n->rx_adaptive  = FALSE;
+}
+
+static void
+io_net_mem_attach(io_net_t* n)
+{
+  // rx buffer is whatever user has set so far. NULL/0 until io_net_set_rx_buf()
+  list_add_tail(&n->mem_le, &n->driver->net->mem.conns);
+  io_net_mem_update(n);
+
+  n->driver->net->stats.connections++;
+}
+
+static void
+io_net_mem_detach(io_net_t* n)
+{
+  io_net_state_t*   st = n->driver->net;
+
+  if(list_empty(&n->mem_le))
+  {
+    return;
+  }
+
+  list_del_init(&n->mem_le);
+  st->mem.total  -= n->mem_held;
+  n->mem_held     = 0;
+
+  st->stats.connections--;
+  st->stats.closes++;
+
+  io_net_mem_check_global(n->driver);
+}
+
+//
+// same trick as postselect. callbacks may close any connection
+//
+static void
+io_net_mem_shed(void* arg)
+{
+  io_net_mem_t*     m = (io_net_mem_t*)arg;
+  io_net_t*         n;
+  struct list_head  run_list;
+  io_net_event_t    ev;
+  bool              pressure_new = m->pressure_new;
+
+  m->pressure_new = FALSE;
+
+  INIT_LIST_HEAD(&run_list);
+  list_splice_init(&m->conns, &run_list);
+
+  while(!list_empty(&run_list))
+  {
+    n = list_first_entry(&run_list, io_net_t, mem_le);
+
+    list_del_init(&n->mem_le);
+    list_add_tail(&n->mem_le, &m->conns);
+
+    if(pressure_new)
+    {
+      // cheap once the cache of the driver is empty
+      io_net_rx_pool_trim(n->driver);
+    }
+
+    if(!m->pressure)
+    {
+      io_net_mem_resume(n, IO_NET_MEM_PAUSED_GLOBAL);
+    }
+
+    memset(&ev, 0, sizeof(ev));
+
+    if((n->mem_paused != 0) != n->mem_reported)
+    {
+      n->mem_reported = n->mem_paused != 0;
+
+      ev.ev = n->mem_reported ? io_net_event_enum_paused : io_net_event_enum_resumed;
+      if(n->cb(n, &ev) == io_net_return_stop)
+      {
+        continue;
+      }
+    }
+
+    if(pressure_new && m->pressure && io_net_mem_idle(n))
+    {
+      if(n->rx_adaptive)
+      {
+        io_net_rx_resize(n, n->rx_min_cls);
+      }
+
+      ev.ev = io_net_event_enum_mem_pressure;
+      n->cb(n, &ev);
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// TCP_INFO sampling
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//
+// glibc struct tcp_info stops at tcpi_total_retrans.
+// kernel layout from there up to tcpi_delivery_rate, 4.9 and later
+//
+typedef struct
+{
+  struct tcp_info   base;
+  uint64_t          pacing_rate;
+  uint64_t          max_pacing_rate;
+  uint64_t          bytes_acked;
+  uint64_t          bytes_received;
+  uint32_t          segs_out;
+  uint32_t          segs_in;
+  uint32_t          notsent_bytes;
+  uint32_t          min_rtt;
+  uint32_t          data_segs_in;
+  uint32_t          data_segs_out;
+  uint64_t          delivery_rate;
+} io_net_tcp_info_kernel_t;
+
+static uint32_t   _tcp_info_interval = IO_NET_TCP_INFO_INTERVAL;
+
+static inline uint32_t
+io_net_now_ms(void)
+{
+  struct timespec   ts;
+
+  // a few msec off doesn't matter here and it never leaves vDSO
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+  return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+//
+// every io_net_t gets this on setup. h is where samples of a connection go
+//
+static inline void
+io_net_tcp_info_init(io_net_t* n, bool conn, io_net_tcp_hist_t* h)
+{
+  memset(&n->tcp, 0, sizeof(io_net_tcp_info_t));
+
+  n->tcp_conn = conn;
+  n->tcp_hist = h;
+}
+
+static int
+io_net_tcp_info_read(io_net_t* n)
+{
+  io_net_tcp_info_kernel_t  ti;
+  socklen_t                 len = sizeof(ti);
+  io_net_tcp_info_t*        t = &n->tcp;
+  io_net_tcp_hist_t*        h = n->tcp_hist;
+
+  if(getsockopt(n->sd, IPPROTO_TCP, TCP_INFO, &ti, &len) != 0 || len < sizeof(struct tcp_info))
+  {
+    return -1;
+  }
+
+  t->rtt_us         = ti.base.tcpi_rtt;
+  t->rttvar_us      = ti.base.tcpi_rttvar;
+  t->retrans        = ti.base.tcpi_total_retrans;
+  t->cwnd           = ti.base.tcpi_snd_cwnd;
+  t->unacked        = ti.base.tcpi_unacked * ti.base.tcpi_snd_mss;
+  t->delivery_rate  = len >= offsetof(io_net_tcp_info_kernel_t, delivery_rate) + sizeof(uint64_t) ?
+                      ti.delivery_rate : 0;
+  t->sampled_ms     = io_net_now_ms();
+  t->samples++;
+
+  if(h != NULL)
+  {
+    io_hist_record(&h->rtt_us, t->rtt_us);
+    io_hist_record(&h->rttvar_us, t->rttvar_us);
+    io_hist_record(&h->cwnd, t->cwnd);
+    io_hist_record(&h->unacked, t->unacked);
+    if(t->delivery_rate != 0)
+    {
+      io_hist_record(&h->delivery_rate, t->delivery_rate);
+    }
+  }
+  return 0;
+}
+
+//
+// on every RX event of a connection. first event samples right away
+// so that short connections are seen too
+//
+static inline void
+io_net_tcp_info_tick(io_net_t* n)
+{
+  if(!n->tcp_conn || _tcp_info_interval == 0)
+  {
+    return;
+  }
+
+  if(n->tcp.samples != 0 && io_net_now_ms() - n->tcp.sampled_ms < _tcp_info_interval)
+  {
+    return;
+  }
+  io_net_tcp_info_read(n);
+}
+
+//
+// last sample has the final retransmit count of the connection
+//
+static void
+io_net_tcp_info_close(io_net_t* n)
+{
+  if(!n->tcp_conn || n->tcp.samples == 0)
+  {
+    return;
+  }
+
+  io_net_tcp_info_read(n);
+  if(n->tcp_hist != NULL)
+  {
+    io_hist_record(&n->tcp_hist->retrans, n->tcp.retrans);
+  }
+  n->tcp_conn = FALSE;
+}
+
+static void
+io_net_tcp_hist_dump_one(const char* name, const io_hist_t* h)
+{
+  LOGI(TAG, "%-14s samples %llu, mean %llu, p50 %llu, p99 %llu, max %llu\n", name,
+      (unsigned long long)h->count,
+      (unsigned long long)io_hist_mean(h),
+      (unsigned long long)io_hist_percentile(h, 50),
+      (unsigned long long)io_hist_percentile(h, 99),
+      (unsigned long long)h->max);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -250,9 +2041,10 @@ io_net_generic_callback(io_driver_watcher_t* w, io_driver_event e)
 
   if((e & IO_DRIVER_EVENT_RX))
   {
+    io_net_tcp_info_tick(n);
     if(io_net_handle_data_rx_event(n) == io_net_return_stop)
     {
-      LOGI(TAG, "%s catching stop\n", __func__);
+      LOGD(TAG, "%s catching stop\n", __func__);
       return;
     }
   }
@@ -292,6 +2084,17 @@ io_net_accept_callback(io_driver_watcher_t* w, io_driver_event e)
     LOGE(TAG, "%s accept failed\n", __func__);
     return;
   }
+  IO_TRACE(l->driver, io_trace_accept, newsd, 0, 0);
+  IO_PROBE2(io_net, accept, l->sd, newsd);
+  l->driver->net->stats.accepts++;
+
+  if(l->driver->net->mem.pressure)
+  {
+    // a new connection would only add to it
+    l->driver->net->mem.rejected++;
+    close(newsd);
+    return;
+  }
 
   memset(&ev, 0, sizeof(ev));
   ev.ev = io_net_event_enum_alloc_connection;
@@ -311,10 +2114,17 @@ io_net_accept_callback(io_driver_watcher_t* w, io_driver_event e)
   n->sd       = newsd;
   n->cb       = l->cb;
   n->driver   = l->driver;
+  n->ssl      = NULL;
+  n->ssl_ctx  = NULL;
 
   io_driver_watcher_init(&n->watcher, newsd, io_net_generic_callback);
+  io_net_stat_init(n, "tcp", from.sin_addr.s_addr, from.sin_port);
   io_driver_watch(n->driver, &n->watcher, IO_DRIVER_EVENT_RX);
 
+  io_net_mem_init(n);
+  io_net_mem_attach(n);
+  io_net_tcp_info_init(n, TRUE, l->tcp_hist);
+
   memset(&ev, 0, sizeof(ev));
   ev.ev = io_net_event_enum_connected;
   ev.from = &from;
@@ -337,6 +2147,7 @@ io_net_connect_callback(io_driver_watcher_t* w, io_driver_event e)
   }
 
   getsockopt(n->sd, SOL_SOCKET, SO_ERROR, &err, &len);
+  memset(&ev, 0, sizeof(ev));
 
   if(err != 0)
   {
@@ -353,7 +2164,6 @@ io_net_connect_callback(io_driver_watcher_t* w, io_driver_event e)
     io_driver_watch(n->driver, &n->watcher, IO_DRIVER_EVENT_RX);
   }
 
-  memset(&ev, 0, sizeof(ev));
   ev.c.n  = n;
   n->cb(n, &ev);
 }
@@ -364,18 +2174,55 @@ io_net_udp_callback(io_driver_watcher_t* w, io_driver_event e)
   io_net_t*       n = container_of(w, io_net_t, watcher);
   int             ret;
   io_net_event_t  ev;
-  socklen_t       from_len = sizeof(struct sockaddr_in);
   struct sockaddr_in from;
+  struct iovec    iov;
+  struct msghdr   msg;
+  struct cmsghdr* cmsg;
+  uint32_t        ovfl = 0;
+  uint8_t         control[CMSG_SPACE(sizeof(uint32_t))];
 
   switch(e)
   {
   case IO_DRIVER_EVENT_RX:
-    ret = recvfrom(n->sd, n->rx_buf, n->rx_size, 0, (struct sockaddr*)&from, &from_len);
+    iov.iov_base        = n->rx_buf;
+    iov.iov_len         = n->rx_size;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name        = &from;
+    msg.msg_namelen     = sizeof(from);
+    msg.msg_iov         = &iov;
+    msg.msg_iovlen      = 1;
+    msg.msg_control     = control;
+    msg.msg_controllen  = sizeof(control);
+
+    ret = recvmsg(n->sd, &msg, 0);
     if(ret <= 0)
     {
-      LOGE(TAG, "%s recvfrom failed\n", __func__);
+      LOGE(TAG, "%s recvmsg failed\n", __func__);
       return;
     }
+    IO_TRACE(n->driver, io_trace_rx, n->sd, 0, ret);
+    IO_PROBE2(io_net, rx, n->sd, ret);
+
+#if defined(SO_RXQ_OVFL)
+    //
+    // kernel drop counter of the socket when this datagram was queued.
+    // no cmsg until the first drop
+    //
+    for(cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+      if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL)
+      {
+        memcpy(&ovfl, CMSG_DATA(cmsg), sizeof(ovfl));
+      }
+    }
+#else
+    UNUSED(cmsg);
+#endif
+    n->udp.dropped  += (uint32_t)(ovfl - n->udp.ovfl);
+    n->udp.ovfl      = ovfl;
+    n->udp.rx++;
+    n->udp.rx_bytes += ret;
 
     ev.ev     = io_net_event_enum_rx;
     ev.r.buf  = n->rx_buf;
@@ -400,37 +2247,65 @@ io_net_udp_callback(io_driver_watcher_t* w, io_driver_event e)
 static void
 io_ssl_generic_callback(io_driver_watcher_t* w, io_driver_event e)
 {
-  io_net_t*       n = container_of(w, io_net_t, watcher);
-  io_ssl_t*       s = n->ssl;
-  int             ret;
-  io_net_event_t  ev;
+  io_net_t*            n = container_of(w, io_net_t, watcher);
+  io_ssl_t*            s = n->ssl;
+  int                  ret,
+                       budget;
+  io_net_event_t       ev;
+  io_ssl_arena_scope_t prev;
 
   if((e & IO_DRIVER_EVENT_RX))
   {
-    ret = mbedtls_ssl_read(&s->ssl, n->rx_buf, n->rx_size);
-    if(ret <= 0)
+    io_net_tcp_info_tick(n);
+  }
+
+  if((e & IO_DRIVER_EVENT_RX) && s->ktls_rx)
+  {
+    if(io_net_handle_data_rx_event(n) == io_net_return_stop)
+    {
+      return;
+    }
+  }
+  else if((e & IO_DRIVER_EVENT_RX))
+  {
+    //
+    // a record larger than rx_size leaves plain text inside mbedtls
+    // where select() can't see it. keep reading within the budget
+    //
+    io_net_rx_adapt(n);
+
+    for(budget = IO_SSL_RX_BUDGET; budget > 0; budget--)
     {
-      switch(ret)
+      io_ssl_enter_arena(s, &prev);
+      ret = mbedtls_ssl_read(&s->ssl, n->rx_buf, n->rx_size);
+      io_ssl_leave_arena(&prev);
+      io_net_rx_account(n, ret);
+      IO_TRACE(n->driver, io_trace_rx, n->sd, 0, MAX(ret, 0));
+      IO_PROBE2(io_net, rx, n->sd, ret);
+
+      if(ret <= 0)
       {
-      case MBEDTLS_ERR_SSL_WANT_READ:
+        switch(ret)
+        {
+        case MBEDTLS_ERR_SSL_WANT_READ:
+          break;
+
+        case MBEDTLS_ERR_SSL_WANT_WRITE:
+          LOGD(TAG, "%s activating TX event\n", __func__);
+          io_driver_watch(n->driver, &n->watcher, IO_DRIVER_EVENT_TX);
+          return;
+
+        case MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY:
+        case MBEDTLS_ERR_NET_CONN_RESET:
+        default:
+          LOGE(TAG, "ssl connection error %x\n", -ret);
+          ev.ev = io_net_event_enum_closed;
+          n->cb(n, &ev);
+          return;
+        }
         break;
-
-      case MBEDTLS_ERR_SSL_WANT_WRITE:
-        LOGI(TAG, "%s activating TX event\n", __func__);
-        io_driver_watch(n->driver, &n->watcher, IO_DRIVER_EVENT_TX);
-        return;
-
-      case MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY:
-      case MBEDTLS_ERR_NET_CONN_RESET:
-      default:
-        LOGE(TAG, "ssl connection error %x\n", -ret);
-        ev.ev = io_net_event_enum_closed;
-        n->cb(n, &ev);
-        return;
       }
-    }
-    else
-    {
+
       ev.ev = io_net_event_enum_rx;
       ev.r.buf = n->rx_buf;
       ev.r.len = (uint32_t)ret;
@@ -438,21 +2313,71 @@ io_ssl_generic_callback(io_driver_watcher_t* w, io_driver_event e)
       {
         return;
       }
+
+      if(n->mem_paused || mbedtls_ssl_get_bytes_avail(&s->ssl) == 0)
+      {
+        // a paused connection is drained on resume
+        break;
+      }
     }
+
+    if(budget == 0 && mbedtls_ssl_get_bytes_avail(&s->ssl) != 0)
+    {
+      // let others run. the rest is delivered at the next loop iteration
+      io_driver_defer(n->driver, &s->rx_more);
+    }
+
+    io_net_mem_update(n);
   }
 
-  if((e & IO_DRIVER_EVENT_TX))
+  if((e & IO_DRIVER_EVENT_TX) && s->ktls_tx)
   {
-    //
-    // XXX
-    // what if mbedtls wants to tx? How should I notify mbedtls of tx availability???
-    //
-    LOGI(TAG, "%s deactivating TX event\n", __func__);
     io_driver_no_watch(n->driver, &n->watcher, IO_DRIVER_EVENT_TX);
 
     ev.ev = io_net_event_enum_tx;
     n->cb(n, &ev);
   }
+  else if((e & IO_DRIVER_EVENT_TX))
+  {
+    ret = io_ssl_tx_flush(s);
+    if(ret < 0)
+    {
+      ev.ev = io_net_event_enum_closed;
+      n->cb(n, &ev);
+      return;
+    }
+
+    if(ret == 0)
+    {
+      // keep TX watch until the pending record is out
+      return;
+    }
+
+    io_driver_no_watch(n->driver, &n->watcher, IO_DRIVER_EVENT_TX);
+    io_net_mem_update(n);
+
+    ev.ev = io_net_event_enum_tx;
+    n->cb(n, &ev);
+  }
+}
+
+static void
+io_ssl_rx_more_callback(void* arg)
+{
+  io_ssl_t*       s = (io_ssl_t*)arg;
+
+  if(s->handshaking)
+  {
+    // handshake pushed out of a loop iteration by admission budget
+    io_ssl_handshake_callback(&s->n->watcher, 0);
+    return;
+  }
+
+  if(s->n->mem_paused)
+  {
+    return;
+  }
+  io_ssl_generic_callback(&s->n->watcher, IO_DRIVER_EVENT_RX);
 }
 
 static void
@@ -462,16 +2387,61 @@ io_ssl_handshake_callback(io_driver_watcher_t* w, io_driver_event e)
   io_ssl_t*       s = n->ssl;
   int             ret;
   io_net_event_t  ev;
+  uint64_t        started;
+
+  if(io_ssl_hs_budget_exhausted(s))
+  {
+    // established connections first. continue at the next loop iteration
+    s->ctx->hs_budget_deferred++;
+    io_driver_defer(n->driver, &s->rx_more);
+    return;
+  }
 
   // blindly disable TX that might have been set
   io_driver_no_watch(n->driver, &n->watcher, IO_DRIVER_EVENT_TX);
 
-  ret = mbedtls_ssl_handshake(&s->ssl);
+  started = io_ssl_now_us();
+  ret = io_ssl_mbedtls_handshake(s);
+  io_ssl_hs_charge(s, io_ssl_now_us() - started);
+  io_net_mem_update(n);
+
   switch(ret)
   {
   case 0:   // handshake done
-    LOGI(TAG, "handshake done\n");
+    IO_TRACE(n->driver, io_trace_hs_done, n->sd, s->resumed, 0);
+    IO_PROBE2(io_net, hs_done, n->sd, s->resumed);
+    LOGI(TAG, "handshake done. %s\n", s->resumed ? "resumed" : "full");
+#if defined(IO_SSL_ARENA)
+    LOGI(TAG, "handshake arena peak %u bytes, %zu reserved\n", s->hs_peak_bytes, s->arena.reserved);
+    s->ctx->hs_arena_peak = MAX(s->ctx->hs_arena_peak, s->hs_peak_bytes);
+#endif
     s->handshaking = FALSE;
+    io_ssl_hs_leave(s);
+
+    if(s->resumed)
+    {
+      s->ctx->resumed_handshakes++;
+    }
+    else
+    {
+      s->ctx->full_handshakes++;
+      if(s->ctx->endpoint == MBEDTLS_SSL_IS_SERVER)
+      {
+        io_ssl_cert_account(s);
+      }
+    }
+
+    if(s->ctx->endpoint == MBEDTLS_SSL_IS_CLIENT)
+    {
+      io_ssl_client_session_save(s);
+    }
+
+    io_ssl_record_size_init(s);
+    io_net_mem_update(n);
+
+#if defined(IO_SSL_KTLS_SUPPORTED)
+    io_ssl_ktls_start(s);
+#endif
 
     io_driver_watcher_set_cb(&n->watcher, io_ssl_generic_callback);
 
@@ -486,13 +2456,19 @@ io_ssl_handshake_callback(io_driver_watcher_t* w, io_driver_event e)
     // RX watch is always enabled
     break;
 
+  case MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS:
+    // private key operation is running on offload pool. resumed on completion
+    break;
+
   case MBEDTLS_ERR_SSL_WANT_WRITE:
-    LOGI(TAG, "%s activating TX event\n", __func__);
+    LOGD(TAG, "%s activating TX event\n", __func__);
     io_driver_watch(n->driver, &n->watcher, IO_DRIVER_EVENT_TX);
     break;
 
   default:  // error
     LOGE(TAG, "handshake failed %x\n", -ret);
+    io_ssl_hs_leave(s);
+
     ev.ev = io_net_event_enum_closed;
     n->cb(n, &ev);
     break;
@@ -504,7 +2480,6 @@ io_ssl_accept_callback(io_driver_watcher_t* w, io_driver_event e)
 {
   int                     newsd;
   io_net_t*               ln = container_of(w, io_net_t, watcher);
-  io_ssl_t*               ls = ln->ssl;
   io_net_t*               n;
   io_ssl_t*               s;
   struct sockaddr_in      from;
@@ -525,8 +2500,26 @@ io_ssl_accept_callback(io_driver_watcher_t* w, io_driver_event e)
     LOGE(TAG, "%s accept failed\n", __func__);
     return;
   }
+  IO_TRACE(ln->driver, io_trace_accept, newsd, 0, 0);
+  IO_PROBE2(io_net, accept, ln->sd, newsd);
+  ln->driver->net->stats.accepts++;
   fcntl(newsd, F_SETFD, FD_CLOEXEC);
 
+  if(io_ssl_hs_queue_full(ln->ssl_ctx))
+  {
+    // shed at the door rather than hold memory for a client that waits anyway
+    ln->ssl_ctx->hs_rejected++;
+    close(newsd);
+    return;
+  }
+
+  if(ln->driver->net->mem.pressure)
+  {
+    ln->driver->net->mem.rejected++;
+    close(newsd);
+    return;
+  }
+
   memset(&ev, 0, sizeof(ev));
   ev.ev = io_net_event_enum_alloc_connection;
   ev.from = &from;
@@ -547,13 +2540,29 @@ io_ssl_accept_callback(io_driver_watcher_t* w, io_driver_event e)
   n->cb       = ln->cb;
   n->driver   = ln->driver;
   n->ssl      = s;
+  n->ssl_ctx  = ln->ssl_ctx;
   s->n        = n;
 
-  io_ssl_mbedtls_init_accepted(ls, s);
+  io_driver_watcher_init(&n->watcher, newsd, io_ssl_handshake_callback);
+  io_net_stat_init(n, "tls", from.sin_addr.s_addr, from.sin_port);
+  io_net_mem_init(n);
+  io_net_tcp_info_init(n, TRUE, ln->tcp_hist);
+
+  if(io_ssl_mbedtls_init(n->ssl_ctx, s) != 0)
+  {
+    // socket is closed by user with io_net_close()
+    n->ssl = NULL;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.ev = io_net_event_enum_closed;
+    n->cb(n, &ev);
+    return;
+  }
   s->handshaking = TRUE;
+  io_net_mem_attach(n);
 
-  io_driver_watcher_init(&n->watcher, newsd, io_ssl_handshake_callback);
-  io_driver_watch(n->driver, &n->watcher, IO_DRIVER_EVENT_RX);
+  // RX is watched once admitted
+  io_ssl_hs_enter(s);
 
   memset(&ev, 0, sizeof(ev));
   ev.ev = io_net_event_enum_connected;
@@ -578,47 +2587,341 @@ io_ssl_connect_callback(io_driver_watcher_t* w, io_driver_event e)
   }
 
   getsockopt(n->sd, SOL_SOCKET, SO_ERROR, &err, &len);
+  memset(&ev, 0, sizeof(ev));
+  ev.c.n    = n;
 
   if(err != 0)
   {
-    // connect failed
-    ev.ev = io_net_event_enum_closed;
+    // connect failed. no handshake on a socket user is closing
+    ev.ev = io_net_event_enum_closed;
+    n->cb(n, &ev);
+    return;
+  }
+
+  // connect success
+  ev.ev = io_net_event_enum_connected;
+  io_driver_no_watch(n->driver, &n->watcher, IO_DRIVER_EVENT_TX);
+  io_driver_watch(n->driver, &n->watcher, IO_DRIVER_EVENT_RX);
+
+  s->handshaking = TRUE;
+  io_driver_watcher_set_cb(&n->watcher, io_ssl_handshake_callback);
+
+  n->cb(n, &ev);
+
+  // initiate handshake
+  io_ssl_handshake_callback(w, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+///////////////////////////////////////////////////////////////////////////////
+int
+io_ssl_ctx_init_server(io_ssl_ctx_t* ctx)
+{
+  int ret;
+
+  if(io_ssl_ctx_init_common(ctx, MBEDTLS_SSL_IS_SERVER) != 0)
+  {
+    goto failed;
+  }
+
+  ret = mbedtls_x509_crt_parse(&ctx->cacert, (const unsigned char *) mbedtls_test_cas_pem,
+      mbedtls_test_cas_pem_len );
+  if(ret != 0)
+  {
+    LOGE(TAG, "failed! mbedtls_x509_crt_parse returned %d\n", ret);
+    goto failed;
+  }
+
+  mbedtls_ssl_conf_ca_chain(&ctx->conf, &ctx->cacert, NULL);
+
+  //
+  // ECDSA first. mbedtls goes with the first pair matching
+  // the cipher suite agreed with client
+  //
+#if defined(MBEDTLS_ECDSA_C)
+  if(io_ssl_ctx_add_cert(ctx,
+        (const uint8_t*)mbedtls_test_srv_crt_ec, mbedtls_test_srv_crt_ec_len,
+        (const uint8_t*)mbedtls_test_srv_key_ec, mbedtls_test_srv_key_ec_len) != 0)
+  {
+    goto failed;
+  }
+#endif
+
+#if defined(MBEDTLS_RSA_C)
+  if(io_ssl_ctx_add_cert(ctx,
+        (const uint8_t*)mbedtls_test_srv_crt_rsa, mbedtls_test_srv_crt_rsa_len,
+        (const uint8_t*)mbedtls_test_srv_key_rsa, mbedtls_test_srv_key_rsa_len) != 0)
+  {
+    goto failed;
+  }
+#endif
+
+  if(io_ssl_ctx_prefer_ecdsa(ctx) != 0)
+  {
+    goto failed;
+  }
+
+  if(io_ssl_ctx_init_resumption(ctx) != 0)
+  {
+    goto failed;
+  }
+
+  return 0;
+
+failed:
+  io_ssl_ctx_deinit(ctx);
+  return -1;
+}
+
+int
+io_ssl_ctx_init_client(io_ssl_ctx_t* ctx)
+{
+  int ret;
+
+  if(io_ssl_ctx_init_common(ctx, MBEDTLS_SSL_IS_CLIENT) != 0)
+  {
+    goto failed;
+  }
+
+  ret = mbedtls_x509_crt_parse(&ctx->cacert, (const unsigned char *) mbedtls_test_cas_pem,
+      mbedtls_test_cas_pem_len );
+  if(ret != 0)
+  {
+    LOGE(TAG, "failed! mbedtls_x509_crt_parse returned %d\n", ret);
+    goto failed;
+  }
+
+  mbedtls_ssl_conf_authmode(&ctx->conf, MBEDTLS_SSL_VERIFY_NONE);
+  mbedtls_ssl_conf_ca_chain(&ctx->conf, &ctx->cacert, NULL );
+
+  if(IO_SSL_MAX_FRAG_LEN != MBEDTLS_SSL_MAX_FRAG_LEN_NONE)
+  {
+    io_ssl_ctx_set_max_frag_len(ctx, IO_SSL_MAX_FRAG_LEN);
+  }
+
+  return 0;
+
+failed:
+  io_ssl_ctx_deinit(ctx);
+  return -1;
+}
+
+void
+io_ssl_ctx_deinit(io_ssl_ctx_t* ctx)
+{
+#if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
+  if(ctx->offload != NULL)
+  {
+    io_ssl_ctx_offload_deinit(ctx);
+  }
+#endif
+
+  for(int i = 0; i < IO_SSL_CLIENT_SESSIONS; i++)
+  {
+    mbedtls_ssl_session_free(&ctx->sessions[i].session);
+    ctx->sessions[i].valid = FALSE;
+  }
+
+#if defined(MBEDTLS_SSL_TICKET_C)
+  mbedtls_ssl_ticket_free(&ctx->ticket);
+#endif
+#if defined(MBEDTLS_SSL_CACHE_C)
+  mbedtls_ssl_cache_free(&ctx->cache);
+#endif
+  mbedtls_x509_crt_free(&ctx->cacert);
+  for(int i = 0; i < IO_SSL_MAX_CERTS; i++)
+  {
+    mbedtls_x509_crt_free(&ctx->certs[i].crt);
+    mbedtls_pk_free(&ctx->certs[i].pkey);
+  }
+  ctx->num_certs = 0;
+
+  if(ctx->ciphersuites != NULL)
+  {
+    io_free(io_allocator_default(), io_alloc_tls, ctx->ciphersuites, sizeof(int) * ctx->num_ciphersuites);
+    ctx->ciphersuites = NULL;
+  }
+  mbedtls_ssl_config_free(&ctx->conf);
+  mbedtls_ctr_drbg_free(&ctx->ctr_drbg);
+  mbedtls_entropy_free(&ctx->entropy);
+}
+
+//
+// run handshake private key operations of a server context on offload pool
+// instead of io_driver thread.
+// the pool must outlive the context
+//
+int
+io_ssl_ctx_enable_offload(io_ssl_ctx_t* ctx, io_offload_t* offload)
+{
+#if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
+  if(ctx->endpoint != MBEDTLS_SSL_IS_SERVER || ctx->num_certs == 0 || ctx->offload != NULL)
+  {
+    return -1;
+  }
+
+  for(int i = 0; i < offload->num_threads; i++)
+  {
+    ctx->workers[i] = io_ssl_worker_alloc(offload->driver);
+    if(ctx->workers[i] == NULL)
+    {
+      LOGE(TAG, "%s failed to allocate worker slot\n", __func__);
+      while(--i >= 0)
+      {
+        io_ssl_worker_free(offload->driver, ctx->workers[i]);
+        ctx->workers[i] = NULL;
+      }
+      return -1;
+    }
+  }
+
+  ctx->offload      = offload;
+  ctx->num_workers  = offload->num_threads;
+
+  mbedtls_ssl_conf_async_private_cb(&ctx->conf,
+      io_ssl_async_sign_start,
+      io_ssl_async_decrypt_start,
+      io_ssl_async_resume,
+      io_ssl_async_cancel,
+      ctx);
+  return 0;
+#else
+  LOGE(TAG, "%s mbedtls built without MBEDTLS_SSL_ASYNC_PRIVATE\n", __func__);
+  return -1;
+#endif
+}
+
+//
+// hand record layer of established connections to kernel TLS.
+// applies to TLS 1.2 AES-GCM connections only. others stay in mbedtls
+//
+int
+io_ssl_ctx_enable_ktls(io_ssl_ctx_t* ctx)
+{
+#if defined(IO_SSL_KTLS_SUPPORTED)
+  ctx->ktls = TRUE;
+
+  mbedtls_ssl_conf_export_keys_ext_cb(&ctx->conf, io_ssl_ktls_export_keys, ctx);
+  return 0;
+#else
+  LOGE(TAG, "%s kTLS not supported in this build\n", __func__);
+  return -1;
+#endif
+}
+
+//
+// adds a certificate/key pair to a server context.
+// crt and key must stay valid as long as the context if offload is used
+//
+int
+io_ssl_ctx_add_cert(io_ssl_ctx_t* ctx, const uint8_t* crt, size_t crt_len,
+    const uint8_t* key, size_t key_len)
+{
+  io_ssl_cert_t*  c;
+  int             ret;
+
+  if(ctx->num_certs >= IO_SSL_MAX_CERTS)
+  {
+    LOGE(TAG, "%s no room for another certificate\n", __func__);
+    return -1;
+  }
+
+  c = &ctx->certs[ctx->num_certs];
+
+  ret = mbedtls_x509_crt_parse(&c->crt, crt, crt_len);
+  if(ret != 0)
+  {
+    LOGE(TAG, "failed! mbedtls_x509_crt_parse returned %d\n", ret);
+    goto failed;
   }
-  else
+
+  ret = mbedtls_pk_parse_key(&c->pkey, key, key_len, NULL, 0);
+  if(ret != 0)
   {
-    // connect success
-    io_driver_watcher_set_cb(&n->watcher, io_ssl_generic_callback);
+    LOGE(TAG, "failed!  mbedtls_pk_parse_key returned %d\n", ret);
+    goto failed;
+  }
 
-    ev.ev = io_net_event_enum_connected;
-    io_driver_no_watch(n->driver, &n->watcher, IO_DRIVER_EVENT_TX);
-    io_driver_watch(n->driver, &n->watcher, IO_DRIVER_EVENT_RX);
+  ret = mbedtls_ssl_conf_own_cert(&ctx->conf, &c->crt, &c->pkey);
+  if(ret != 0)
+  {
+    LOGE(TAG, "failed!  mbedtls_ssl_conf_own_cert returned %d\n", ret);
+    goto failed;
   }
 
-  s->handshaking = TRUE;
-  io_driver_watcher_set_cb(&n->watcher, io_ssl_handshake_callback);
+  c->key_src      = key;
+  c->key_src_len  = key_len;
+  c->handshakes   = 0;
 
-  memset(&ev, 0, sizeof(ev));
-  ev.c.n    = n;
-  n->cb(n, &ev);      // FIXME
+  ctx->num_certs++;
+  return 0;
 
-  // initiate handshake
-  io_ssl_handshake_callback(w, 0);
+failed:
+  mbedtls_x509_crt_free(&c->crt);
+  mbedtls_x509_crt_init(&c->crt);
+  mbedtls_pk_free(&c->pkey);
+  mbedtls_pk_init(&c->pkey);
+  return -1;
 }
 
-///////////////////////////////////////////////////////////////////////////////
 //
-// public interfaces
+// overrides cipher suites offered/accepted. list is 0 terminated
+// and must outlive the context
 //
-///////////////////////////////////////////////////////////////////////////////
+void
+io_ssl_ctx_set_ciphersuites(io_ssl_ctx_t* ctx, const int* ciphersuites)
+{
+  mbedtls_ssl_conf_ciphersuites(&ctx->conf, ciphersuites);
+}
+
+//
+// client contexts request max_fragment_length. server contexts honor what clients
+// request anyway and use this as an upper limit of their own records
+//
+int
+io_ssl_ctx_set_max_frag_len(io_ssl_ctx_t* ctx, uint8_t mfl_code)
+{
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+  if(mbedtls_ssl_conf_max_frag_len(&ctx->conf, mfl_code) != 0)
+  {
+    LOGE(TAG, "%s invalid mfl code %d\n", __func__, mfl_code);
+    return -1;
+  }
+  return 0;
+#else
+  LOGE(TAG, "%s mbedtls built without MBEDTLS_SSL_MAX_FRAGMENT_LENGTH\n", __func__);
+  return -1;
+#endif
+}
+
+//
+// handshake admission limits. 0 disables the corresponding limit.
+// max_active/max_queued apply to connections accepted with this context,
+// budget_us to every handshake of this context
+//
+void
+io_ssl_ctx_set_handshake_limits(io_ssl_ctx_t* ctx, int max_active, int max_queued, uint32_t budget_us)
+{
+  ctx->hs_max_active  = max_active;
+  ctx->hs_max_queued  = max_queued;
+  ctx->hs_budget_us   = budget_us;
+
+  io_ssl_hs_admit(ctx);
+}
+
 int
-io_net_bind(io_driver_t* driver, io_net_t* n, io_ssl_t* s, int port, io_net_callback cb)
+io_net_bind(io_driver_t* driver, io_net_t* n, io_ssl_ctx_t* ctx, int port, io_net_callback cb)
 {
   int                   sd;
   const int             on = 1;
   struct sockaddr_in    addr;
 
-  if(s && io_ssl_mbedtls_init_server(s) != 0)
+  if(io_net_state(driver) == NULL)
   {
+    LOGE(TAG, "%s failed to allocate state\n", __func__);
     return -1;
   }
 
@@ -626,7 +2929,7 @@ io_net_bind(io_driver_t* driver, io_net_t* n, io_ssl_t* s, int port, io_net_call
   if(sd < 0)
   {
     LOGE(TAG, "%s socket failed\n", __func__);
-    goto socket_failed;
+    return -1;
   }
   fcntl(sd, F_SETFD, FD_CLOEXEC);
 
@@ -641,7 +2944,8 @@ io_net_bind(io_driver_t* driver, io_net_t* n, io_ssl_t* s, int port, io_net_call
   if(bind(sd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
   {
     LOGE(TAG, "%s failed to bind %d\n", __func__, port);
-    goto bind_failed;
+    close(sd);
+    return -1;
   }
 
   listen(sd, 5);
@@ -649,43 +2953,38 @@ io_net_bind(io_driver_t* driver, io_net_t* n, io_ssl_t* s, int port, io_net_call
   n->sd       = sd;
   n->cb       = cb;
   n->driver   = driver;
-  n->ssl      = s;
-  if(s)
+  n->ssl      = NULL;
+  n->ssl_ctx  = ctx;
+
+  io_net_mem_init(n);
+  io_net_tcp_info_init(n, FALSE, NULL);
+
+  if(ctx)
   {
     io_driver_watcher_init(&n->watcher, sd, io_ssl_accept_callback);
+    io_net_stat_init(n, "listen-tls", 0, addr.sin_port);
     io_driver_watch(driver, &n->watcher, IO_DRIVER_EVENT_RX);
-
-    s->mbed_fd.fd = n->sd;
-    s->n = n;
   }
   else
   {
     io_driver_watcher_init(&n->watcher, sd, io_net_accept_callback);
+    io_net_stat_init(n, "listen", 0, addr.sin_port);
     io_driver_watch(driver, &n->watcher, IO_DRIVER_EVENT_RX);
   }
 
   return 0;
-
-bind_failed:
-  close(sd);
-
-socket_failed:
-  if(s)
-  {
-    io_ssl_mbedtls_deinit(s);
-  }
-  return -1;
 }
 
 int
-io_net_connect(io_driver_t* driver, io_net_t* n, io_ssl_t* s,
+io_net_connect(io_driver_t* driver, io_net_t* n, io_ssl_ctx_t* ctx, io_ssl_t* s,
     const char* ip_addr, int port, io_net_callback cb)
 {
   int                 sd;
   struct sockaddr_in  to;
 
-  if(s && io_ssl_mbedtls_init_client(s) != 0)
+  if(io_net_state(driver) == NULL)
   {
+    LOGE(TAG, "%s failed to allocate state\n", __func__);
     return -1;
   }
 
@@ -693,7 +2992,7 @@ io_net_connect(io_driver_t* driver, io_net_t* n, io_ssl_t* s,
   if(sd < 0)
   {
     LOGE(TAG, "%s socket failed\n", __func__);
-    goto socket_failed;
+    return -1;
   }
   fcntl(sd, F_SETFD, FD_CLOEXEC);
 
@@ -708,21 +3007,41 @@ io_net_connect(io_driver_t* driver, io_net_t* n, io_ssl_t* s,
   n->cb       = cb;
   n->driver   = driver;
   n->ssl      = s;
+  n->ssl_ctx  = ctx;
+
+  io_net_mem_init(n);
+  io_net_tcp_info_init(n, TRUE, NULL);
 
   if(s)
   {
+    s->n          = n;
+    s->peer_addr  = to.sin_addr.s_addr;
+    s->peer_port  = to.sin_port;
+
+    if(io_ssl_mbedtls_init(ctx, s) != 0)
+    {
+      n->ssl = NULL;
+      close(sd);
+      return -1;
+    }
+
+    // offer the last session with this endpoint for resumption
+    io_ssl_client_session_load(s);
+
     io_driver_watcher_init(&n->watcher, sd, io_ssl_connect_callback);
+    io_net_stat_init(n, "tls", to.sin_addr.s_addr, to.sin_port);
     io_driver_watch(driver, &n->watcher, IO_DRIVER_EVENT_TX);
-
-    s->n      = n;
-    s->mbed_fd.fd = n->sd;
   }
   else
   {
     io_driver_watcher_init(&n->watcher, sd, io_net_connect_callback);
+    io_net_stat_init(n, "tcp", to.sin_addr.s_addr, to.sin_port);
     io_driver_watch(driver, &n->watcher, IO_DRIVER_EVENT_TX);
   }
 
+  io_net_mem_attach(n);
+  driver->net->stats.connects++;
+
   //
   // don't care about return value here
   // anyway any error will be detected at the next loop
@@ -730,24 +3049,26 @@ io_net_connect(io_driver_t* driver, io_net_t* n, io_ssl_t* s,
   connect(sd, (struct sockaddr*)&to, sizeof(to));
 
   return 0;
-
-socket_failed:
-  if(s)
-  {
-    io_ssl_mbedtls_deinit(s);
-  }
-  return -1;
 }
 
 void
 io_net_close(io_net_t* n)
 {
+  IO_TRACE(n->driver, io_trace_close, n->sd, 0, 0);
+  IO_PROBE1(io_net, close, n->sd);
+
+  io_net_tcp_info_close(n);
+  io_net_mem_detach(n);
+  io_net_rx_release(n);
+
   io_driver_no_watch(n->driver,
       &n->watcher,
       IO_DRIVER_EVENT_RX | IO_DRIVER_EVENT_TX | IO_DRIVER_EVENT_EX);
 
   if(n->ssl != NULL)
   {
+    io_driver_cancel_deferred(n->driver, &n->ssl->rx_more);
+    io_ssl_hs_leave(n->ssl);
     io_ssl_mbedtls_deinit(n->ssl);
   }
   close(n->sd);
@@ -759,15 +3080,21 @@ io_net_close(io_net_t* n)
 //      0, if tx event is scheduled
 //     -1, if error
 //
+// for TLS, "written" means accepted by mbedtls or queued in the TLS send queue.
+// either way the data goes out in order as the socket becomes writable
+// and tx event is delivered once everything is flushed.
+//
 int
 io_net_tx(io_net_t* n, uint8_t* buf, int len)
 {
   int ret;
   io_ssl_t*   s = n->ssl;
 
-  if(s == NULL)
+  if(s == NULL || s->ktls_tx)
   {
     ret = write(n->sd, buf, len);
+    IO_TRACE(n->driver, io_trace_tx, n->sd, 0, MAX(ret, 0));
+    IO_PROBE3(io_net, tx, n->sd, len, ret);
     if(ret <= 0)
     {
       if(!(errno == EWOULDBLOCK || errno == EAGAIN))
@@ -777,6 +3104,7 @@ io_net_tx(io_net_t* n, uint8_t* buf, int len)
       io_driver_watch(n->driver, &n->watcher, IO_DRIVER_EVENT_TX);
       return 0;
     }
+    n->driver->net->stats.tx_bytes += ret;
     return ret;
   }
   else
@@ -787,24 +3115,72 @@ io_net_tx(io_net_t* n, uint8_t* buf, int len)
       return -1;
     }
 
-    ret = mbedtls_ssl_write(&s->ssl, buf, len);
-    if(ret <= 0)
+    if(s->ssl.out_left != 0 || !circ_buffer_is_empty(&s->txq))
+    {
+      // keep ordering behind what is already pending
+      ret = io_ssl_tx_enqueue(s, buf, len);
+    }
+    else
     {
-      if(ret != MBEDTLS_ERR_SSL_WANT_WRITE)
+      ret = io_ssl_write_records(s, buf, len);
+      if(ret < 0)
       {
         return -1;
       }
-      LOGI(TAG, "%s activating TX event\n", __func__);
+
+      if(ret < len)
+      {
+        ret += io_ssl_tx_enqueue(s, &buf[ret], len - ret);
+      }
+    }
+
+    if(s->ssl.out_left != 0)
+    {
       io_driver_watch(n->driver, &n->watcher, IO_DRIVER_EVENT_TX);
     }
+
+    IO_TRACE(n->driver, io_trace_tx, n->sd, 0, ret);
+    IO_PROBE3(io_net, tx, n->sd, len, ret);
+    io_net_mem_update(n);
+    n->driver->net->stats.tx_bytes += ret;
     return ret;
   }
 }
 
+//
+// zero copy file transmission. for TLS, only with kTLS TX.
+// offset is updated like sendfile(2)
+//
+int
+io_net_sendfile(io_net_t* n, int in_fd, off_t* offset, int count)
+{
+  int ret;
+
+  if(n->ssl != NULL && !n->ssl->ktls_tx)
+  {
+    LOGE(TAG, "%s requires kTLS TX for TLS connection\n", __func__);
+    return -1;
+  }
+
+  ret = sendfile(n->sd, in_fd, offset, count);
+  if(ret < 0)
+  {
+    if(!(errno == EWOULDBLOCK || errno == EAGAIN))
+    {
+      return -1;
+    }
+    io_driver_watch(n->driver, &n->watcher, IO_DRIVER_EVENT_TX);
+    return 0;
+  }
+  n->driver->net->stats.tx_bytes += ret;
+  return ret;
+}
+
 int
 io_net_udp(io_driver_t* driver, io_net_t* n, int port, io_net_callback cb)
 {
   int                 sd;
+  const int           on = 1;
   struct sockaddr_in  mine;
 
   sd = socket(AF_INET, SOCK_DGRAM, 0);
@@ -829,11 +3205,27 @@ io_net_udp(io_driver_t* driver, io_net_t* n, int port, io_net_callback cb)
     goto bind_failed;
   }
 
-  n->sd     = sd;
-  n->cb     = cb;
-  n->driver = driver;
+#if defined(SO_RXQ_OVFL)
+  if(setsockopt(sd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) != 0)
+  {
+    LOGE(TAG, "%s SO_RXQ_OVFL failed. kernel drops are not counted\n", __func__);
+  }
+#endif
+
+  n->sd      = sd;
+  n->cb      = cb;
+  n->driver  = driver;
+  n->ssl     = NULL;
+  n->ssl_ctx = NULL;
+
+  io_net_mem_init(n);
+  io_net_tcp_info_init(n, FALSE, NULL);
+
+  memset(&n->udp, 0, sizeof(io_net_udp_stats_t));
+  io_net_udp_set_bufs(n, IO_NET_UDP_RCVBUF, IO_NET_UDP_SNDBUF);
 
   io_driver_watcher_init(&n->watcher, sd, io_net_udp_callback);
+  io_net_stat_init(n, "udp", 0, mine.sin_port);
   io_driver_watch(driver, &n->watcher, IO_DRIVER_EVENT_RX);
 
   return 0;
@@ -857,5 +3249,279 @@ io_net_udp_tx(io_net_t* n, struct sockaddr_in* to, uint8_t* buf, int len)
     return 0;
   }
 
+  n->udp.tx_failed++;
   return -1;
 }
+
+//
+// socket buffer sizes of a UDP socket in bytes. 0 leaves one as it is.
+// a bigger receive buffer rides out longer stalls of the loop before kernel drops.
+// beyond net.core.rmem_max/wmem_max only with CAP_NET_ADMIN.
+// sizes kernel actually took are in n->udp.
+// @return -1 if a size couldn't be set
+//
+int
+io_net_udp_set_bufs(io_net_t* n, int rcvbuf, int sndbuf)
+{
+  int         ret = 0;
+  socklen_t   len;
+
+  if(rcvbuf > 0 &&
+     setsockopt(n->sd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) != 0 &&
+     setsockopt(n->sd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) != 0)
+  {
+    LOGE(TAG, "%s SO_RCVBUF %d failed\n", __func__, rcvbuf);
+    ret = -1;
+  }
+
+  if(sndbuf > 0 &&
+     setsockopt(n->sd, SOL_SOCKET, SO_SNDBUFFORCE, &sndbuf, sizeof(sndbuf)) != 0 &&
+     setsockopt(n->sd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf)) != 0)
+  {
+    LOGE(TAG, "%s SO_SNDBUF %d failed\n", __func__, sndbuf);
+    ret = -1;
+  }
+
+  len = sizeof(int);
+  getsockopt(n->sd, SOL_SOCKET, SO_RCVBUF, &n->udp.rcvbuf, &len);
+  len = sizeof(int);
+  getsockopt(n->sd, SOL_SOCKET, SO_SNDBUF, &n->udp.sndbuf, &len);
+
+  if(n->udp.rcvbuf < rcvbuf)
+  {
+    // kernel doubles what it takes for bookkeeping but caps it at rmem_max
+    LOGI(TAG, "%s receive buffer %d for %d asked\n", __func__, n->udp.rcvbuf, rcvbuf);
+  }
+  return ret;
+}
+
+//
+// re-accounts connection n and applies the limits.
+// called by io_net itself whenever something it knows of changes
+//
+void
+io_net_mem_update(io_net_t* n)
+{
+  io_net_mem_t*   m;
+  uint32_t        held;
+
+  if(n->mem_le.next == NULL || list_empty(&n->mem_le))
+  {
+    // listener, UDP or not connected yet. a zeroed io_net_t is not attached either
+    return;
+  }
+
+  m    = &n->driver->net->mem;
+  held = io_net_mem_measure(n);
+
+  m->total  += (int64_t)held - n->mem_held;
+  m->peak    = MAX(m->peak, m->total);
+
+  if(n->ssl != NULL && n->ssl->handshaking)
+  {
+    // handshake is driven by RX. admission control limits these
+    n->mem_held = held;
+    io_net_mem_check_global(n->driver);
+    return;
+  }
+
+  if(m->conn_limit != 0 && held > m->conn_limit)
+  {
+    io_net_mem_pause(n, IO_NET_MEM_PAUSED_CONN);
+  }
+  else
+  {
+    io_net_mem_resume(n, IO_NET_MEM_PAUSED_CONN);
+  }
+
+  io_net_mem_check_global(n->driver);
+
+  if(m->pressure && held > n->mem_held)
+  {
+    io_net_mem_pause(n, IO_NET_MEM_PAUSED_GLOBAL);
+  }
+  n->mem_held = held;
+}
+
+//
+// application memory tied to connection n, like its own output queue.
+// negative delta gives it back
+//
+void
+io_net_mem_charge(io_net_t* n, int delta)
+{
+  if(delta < 0 && (uint32_t)-delta > n->mem_app)
+  {
+    n->mem_app = 0;
+  }
+  else
+  {
+    n->mem_app += delta;
+  }
+  io_net_mem_update(n);
+}
+
+//
+// limits apply to connections of the driver. the global limit is for all of them
+//
+int
+io_net_mem_set_limits(io_driver_t* driver, uint32_t conn_limit, uint64_t global_limit)
+{
+  io_net_state_t*   st = io_net_state(driver);
+  io_net_t*         n;
+
+  if(st == NULL)
+  {
+    return -1;
+  }
+
+  st->mem.conn_limit   = conn_limit;
+  st->mem.global_limit = global_limit;
+
+  list_for_each_entry(n, &st->mem.conns, mem_le)
+  {
+    io_net_mem_update(n);
+  }
+  return 0;
+}
+
+//
+// NULL before the driver has a listener or connection
+//
+const io_net_mem_t*
+io_net_mem_stats(io_driver_t* driver)
+{
+  return driver->net != NULL ? &driver->net->mem : NULL;
+}
+
+const io_net_stats_t*
+io_net_stats(io_driver_t* driver)
+{
+  return driver->net != NULL ? &driver->net->stats : NULL;
+}
+
+//
+// rx buffer managed by io_net. starts at min_size and moves between
+// power of 2 classes up to max_size as reads keep filling it or stay small.
+// call on io_net_event_enum_connected instead of io_net_set_rx_buf()
+//
+int
+io_net_set_rx_adaptive(io_net_t* n, int min_size, int max_size)
+{
+  int         min_cls = io_net_rx_class(min_size),
+              max_cls = io_net_rx_class(max_size);
+  uint8_t*    b;
+
+  b = io_net_rx_get(n->driver, min_cls);
+  if(b == NULL)
+  {
+    return -1;
+  }
+  io_net_rx_release(n);
+
+  n->rx_adaptive  = TRUE;
+  n->rx_buf       = b;
+  n->rx_size      = IO_NET_RX_CLASS_SIZE(min_cls);
+  n->rx_cls       = min_cls;
+  n->rx_min_cls   = min_cls;
+  n->rx_max_cls   = MAX(min_cls, max_cls);
+  n->rx_filled    = FALSE;
+  n->rx_small     = 0;
+
+  io_net_mem_update(n);
+  return 0;
+}
+
+//
+// replaces default label of the connection in watcher stats,
+// "telnet:10.0.0.5" for example. no-op without IO_DRIVER_METRICS
+//
+void
+io_net_set_label(io_net_t* n, const char* label)
+{
+#if defined(IO_DRIVER_METRICS)
+  memset(n->stat.label, 0, IO_DRIVER_STAT_LABEL);
+  strncpy(n->stat.label, label, IO_DRIVER_STAT_LABEL - 1);
+#else
+  UNUSED(n);
+  UNUSED(label);
+#endif
+}
+
+//
+// 0 stops periodic sampling. connections are then sampled
+// only by io_net_tcp_info_sample() and on close
+//
+void
+io_net_tcp_info_set_interval(uint32_t msec)
+{
+  _tcp_info_interval = msec;
+}
+
+//
+// samples go to h as well as n->tcp. for a listener, call after io_net_bind()
+// and connections accepted from then on record into h.
+// h is initialized with io_net_tcp_hist_init() and may be shared by listeners
+//
+void
+io_net_tcp_info_attach(io_net_t* n, io_net_tcp_hist_t* h)
+{
+  n->tcp_hist = h;
+}
+
+//
+// samples connection now regardless of interval.
+// @return -1 if n is not a TCP connection
+//
+int
+io_net_tcp_info_sample(io_net_t* n)
+{
+  if(!n->tcp_conn)
+  {
+    return -1;
+  }
+  return io_net_tcp_info_read(n);
+}
+
+void
+io_net_tcp_hist_init(io_net_tcp_hist_t* h)
+{
+  io_hist_init(&h->rtt_us);
+  io_hist_init(&h->rttvar_us);
+  io_hist_init(&h->cwnd);
+  io_hist_init(&h->unacked);
+  io_hist_init(&h->delivery_rate);
+  io_hist_init(&h->retrans);
+}
+
+void
+io_net_tcp_hist_dump(const io_net_tcp_hist_t* h)
+{
+  io_net_tcp_hist_dump_one("rtt us", &h->rtt_us);
+  io_net_tcp_hist_dump_one("rttvar us", &h->rttvar_us);
+  io_net_tcp_hist_dump_one("cwnd", &h->cwnd);
+  io_net_tcp_hist_dump_one("unacked bytes", &h->unacked);
+  io_net_tcp_hist_dump_one("delivery B/s", &h->delivery_rate);
+  io_net_tcp_hist_dump_one("retrans", &h->retrans);
+}
+
+void
+io_net_rx_pool_dump(io_driver_t* driver)
+{
+  io_net_rx_pools_t*  pools = driver->rx_pools;
+  io_net_rx_pool_t*   p;
+
+  if(pools == NULL)
+  {
+    LOGI(TAG, "rx pool not used\n");
+    return;
+  }
+
+  for(int cls = 0; cls < IO_NET_RX_CLASSES; cls++)
+  {
+    p = &pools->pools[cls];
+    LOGI(TAG, "rx pool %6d: in use %u, peak %u, cached %u\n",
+        IO_NET_RX_CLASS_SIZE(cls), p->in_use, p->peak, p->cached);
+  }
+  LOGI(TAG, "rx pool grows %u, shrinks %u\n", pools->grows, pools->shrinks);
+}
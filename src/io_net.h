@@ -27,13 +27,147 @@
 #include "mbedtls/ctr_drbg.h"
 #include "mbedtls/error.h"
 #include "mbedtls/certs.h"
+#include "mbedtls/ssl_cache.h"
+#include "mbedtls/ssl_ticket.h"
 
+#include <stddef.h>
 #include <string.h>
+#include <sys/types.h>
 
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
 #include "io_driver.h"
+#include "circ_buffer.h"
+#include "io_offload.h"
+#include "io_ssl_arena.h"
+
+//
+// TLS session resumption
+//
+#ifndef IO_SSL_SESSION_CACHE_SIZE
+#define IO_SSL_SESSION_CACHE_SIZE         32        // server side session cache entries
+#endif
+
+#ifndef IO_SSL_SESSION_TIMEOUT
+#define IO_SSL_SESSION_TIMEOUT            86400     // server side session cache timeout in second
+#endif
+
+#ifndef IO_SSL_TICKET_LIFETIME
+#define IO_SSL_TICKET_LIFETIME            3600      // ticket key rotation period in second
+#endif
+
+//
+// max number of mbedtls_ssl_read() calls per RX event
+// to drain plain text already decrypted inside mbedtls.
+// the rest is delivered at the next loop iteration
+//
+#ifndef IO_SSL_RX_BUDGET
+#define IO_SSL_RX_BUDGET                  8
+#endif
+
+//
+// handshake admission control of server contexts.
+// established connections keep being served while a flood of new clients
+// waits in the admission queue. 0 means no limit
+//
+#ifndef IO_SSL_HS_MAX_ACTIVE
+#define IO_SSL_HS_MAX_ACTIVE              16        // concurrent handshakes in progress
+#endif
+
+#ifndef IO_SSL_HS_MAX_QUEUED
+#define IO_SSL_HS_MAX_QUEUED              64        // accepted sockets waiting for a handshake slot
+#endif
+
+#ifndef IO_SSL_HS_BUDGET_US
+#define IO_SSL_HS_BUDGET_US               10000     // handshake CPU time per loop iteration in usec
+#endif
+
+//
+// dynamic TLS record sizing.
+// a new or idle connection sends records fitting in one TCP segment
+// so the peer can decrypt the first bytes early. after IO_SSL_REC_GROW_BYTES
+// are sent without going idle, records grow to the negotiated maximum.
+// 0 for IO_SSL_REC_GROW_BYTES always uses the maximum
+//
+#ifndef IO_SSL_REC_GROW_BYTES
+#define IO_SSL_REC_GROW_BYTES             (1024 * 1024)
+#endif
+
+#ifndef IO_SSL_REC_IDLE_MS
+#define IO_SSL_REC_IDLE_MS                1000      // back to small records after this idle period
+#endif
+
+#ifndef IO_SSL_REC_MSS_DEFAULT
+#define IO_SSL_REC_MSS_DEFAULT            1460      // when TCP_MAXSEG is not available
+#endif
+
+//
+// max_fragment_length requested by client contexts. one of MBEDTLS_SSL_MAX_FRAG_LEN_XXX.
+// with MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH, mbedtls shrinks record buffers
+// of the connection once the peer accepts it
+//
+#ifndef IO_SSL_MAX_FRAG_LEN
+#define IO_SSL_MAX_FRAG_LEN               MBEDTLS_SSL_MAX_FRAG_LEN_NONE
+#endif
+
+#ifndef IO_SSL_MAX_CERTS
+#define IO_SSL_MAX_CERTS                  2         // certificate/key pairs per server context
+#endif
+
+#ifndef IO_SSL_CLIENT_SESSIONS
+#define IO_SSL_CLIENT_SESSIONS            4         // number of endpoints a client context remembers
+#endif
+
+//
+// memory accounting of TCP connections.
+// bytes held by a connection are its rx buffer, TLS send queue, TLS state
+// and whatever the application charges with io_net_mem_charge().
+//
+// a connection holding more than IO_NET_MEM_CONN_LIMIT stops reading until
+// it drops below. once all connections together reach IO_NET_MEM_GLOBAL_LIMIT,
+// new connections are rejected, growing connections stop reading and
+// idle ones get io_net_event_enum_mem_pressure to release what they can.
+// pressure ends below IO_NET_MEM_LOW_PCT percent of the global limit.
+// 0 means no limit. both can be changed with io_net_mem_set_limits()
+//
+// accounting is process wide. all io_net connections must run on one thread
+//
+#ifndef IO_NET_MEM_CONN_LIMIT
+#define IO_NET_MEM_CONN_LIMIT             0
+#endif
+
+#ifndef IO_NET_MEM_GLOBAL_LIMIT
+#define IO_NET_MEM_GLOBAL_LIMIT           0
+#endif
+
+#ifndef IO_NET_MEM_LOW_PCT
+#define IO_NET_MEM_LOW_PCT                75
+#endif
+
+//
+// adaptive rx buffers. see io_net_set_rx_adaptive()
+// buffers come in power of 2 classes from 1 << IO_NET_RX_MIN_SHIFT
+// to 1 << IO_NET_RX_MAX_SHIFT. up to IO_NET_RX_POOL_CACHE released buffers
+// are kept per class for the next connection
+//
+#ifndef IO_NET_RX_MIN_SHIFT
+#define IO_NET_RX_MIN_SHIFT               7         // 128 bytes
+#endif
+
+#ifndef IO_NET_RX_MAX_SHIFT
+#define IO_NET_RX_MAX_SHIFT               14        // 16K bytes
+#endif
+
+#ifndef IO_NET_RX_POOL_CACHE
+#define IO_NET_RX_POOL_CACHE              8
+#endif
+
+#ifndef IO_NET_RX_SHRINK_READS
+#define IO_NET_RX_SHRINK_READS            8         // reads under a quarter of the buffer in a row to shrink
+#endif
+
+#define IO_NET_RX_CLASSES                 (IO_NET_RX_MAX_SHIFT - IO_NET_RX_MIN_SHIFT + 1)
 
 typedef enum
 {
@@ -43,14 +177,92 @@ typedef enum
   io_net_event_enum_rx,
   io_net_event_enum_tx,
   io_net_event_enum_closed,
+  io_net_event_enum_paused,           // reads stopped by memory accounting
+  io_net_event_enum_resumed,          // reads restarted
+  io_net_event_enum_mem_pressure,     // global memory pressure. release idle buffers
 } io_net_event_enum_t;
 
+//
+// TCP_INFO of a connection. sampled while it has traffic, at most once
+// every IO_NET_TCP_INFO_INTERVAL msec, and once more on close.
+// see io_net_tcp_info_set_interval()
+//
+#ifndef IO_NET_TCP_INFO_INTERVAL
+#define IO_NET_TCP_INFO_INTERVAL          1000      // msec
+#endif
+
+typedef struct
+{
+  uint64_t      delivery_rate;      // bytes/sec. 0 if kernel doesn't report it
+  uint32_t      rtt_us;
+  uint32_t      rttvar_us;
+  uint32_t      retrans;            // total retransmitted segments
+  uint32_t      cwnd;               // segments
+  uint32_t      unacked;            // bytes. unacked segments * mss
+  uint32_t      sampled_ms;         // coarse monotonic msec of last sample
+  uint32_t      samples;
+} io_net_tcp_info_t;
+
+//
+// samples of all connections accepted by a listener. see io_net_tcp_info_attach()
+//
+typedef struct
+{
+  io_hist_t     rtt_us;
+  io_hist_t     rttvar_us;
+  io_hist_t     cwnd;
+  io_hist_t     unacked;
+  io_hist_t     delivery_rate;
+  io_hist_t     retrans;            // per connection, recorded on close
+} io_net_tcp_hist_t;
+
+//
+// counters of all connections of a driver. see io_net_stats()
+//
+typedef struct
+{
+  uint64_t      accepts;
+  uint64_t      connects;
+  uint64_t      closes;             // of accepted or connected
+  uint64_t      rx_bytes;           // TCP and TLS payload
+  uint64_t      tx_bytes;
+  uint32_t      connections;        // open now
+} io_net_stats_t;
+
+//
+// UDP socket statistics. see io_net_udp_set_bufs()
+//
+#ifndef IO_NET_UDP_RCVBUF
+#define IO_NET_UDP_RCVBUF                 0         // bytes. 0 for system default
+#endif
+
+#ifndef IO_NET_UDP_SNDBUF
+#define IO_NET_UDP_SNDBUF                 0
+#endif
+
+typedef struct
+{
+  uint64_t      rx;                 // datagrams
+  uint64_t      rx_bytes;
+  uint64_t      dropped;            // by kernel. receive queue was full
+  uint32_t      ovfl;               // kernel drop counter as of last datagram
+  uint32_t      tx_failed;
+  int           rcvbuf;             // bytes, as set by kernel
+  int           sndbuf;
+} io_net_udp_stats_t;
+
 struct __io_net_t;
 typedef struct __io_net_t io_net_t;
 
 struct __io_ssl_t;
 typedef struct __io_ssl_t io_ssl_t;
 
+struct __io_ssl_ctx_t;
+typedef struct __io_ssl_ctx_t io_ssl_ctx_t;
+
+struct __io_ssl_ktls_keys_t;
+typedef struct __io_ssl_ktls_keys_t io_ssl_ktls_keys_t;
+
 typedef struct
 {
   io_net_event_enum_t     ev;
@@ -77,14 +289,16 @@ typedef enum
 
 typedef io_net_return_t (*io_net_callback)(io_net_t* n, io_net_event_t* e);
 
+//
+// fields touched on every event come first and fill exactly one cache line.
+// allocate io_net_t IO_CACHE_LINE aligned to get them in a single line.
+// ssl is in the line too except in IO_DRIVER_METRICS builds where the
+// watcher stat pointer pushes it to the next
+//
 struct __io_net_t
 {
-  int                   sd;
-  io_net_callback       cb;
   io_driver_watcher_t   watcher;
-  io_driver_t*          driver;
-
-  io_ssl_t*             ssl;
+  io_net_callback       cb;
   ////////////////////////////////////////////
   // XXX
   // these should be set by user
@@ -92,37 +306,288 @@ struct __io_net_t
   ////////////////////////////////////////////
   uint8_t*              rx_buf;
   int                   rx_size;
+  int                   sd;
+  io_ssl_t*             ssl;
+
+  // cold. setup, teardown and TX watch toggling
+  io_driver_t*          driver;
+  io_ssl_ctx_t*         ssl_ctx;
+
+  // memory accounting. see IO_NET_MEM_XXX
+  struct list_head      mem_le;         // in accounted connections while open
+  uint32_t              mem_held;       // bytes as of last update
+  uint32_t              mem_app;        // charged by application
+  uint8_t               mem_paused;     // IO_NET_MEM_PAUSED_XXX
+  uint8_t               mem_reported;   // application was told reads are paused
+
+  // adaptive rx buffer. see io_net_set_rx_adaptive()
+  uint8_t               rx_adaptive;
+  uint8_t               rx_cls;         // class of rx_buf
+  uint8_t               rx_min_cls;
+  uint8_t               rx_max_cls;
+  uint8_t               rx_filled;      // last read filled rx_buf
+  uint8_t               rx_small;       // small reads in a row
+
+  // TCP_INFO sampling. see io_net_tcp_info_attach()
+  uint8_t               tcp_conn;       // connected TCP socket. not listener or UDP
+  io_net_tcp_info_t     tcp;
+  io_net_tcp_hist_t*    tcp_hist;
+
+  // UDP only. updated before rx event, so a jump of udp.dropped
+  // in the callback means datagrams were lost in front of this one
+  io_net_udp_stats_t    udp;
+
+#if defined(IO_DRIVER_METRICS)
+  io_driver_watcher_stat_t  stat;       // "tcp:<peer>" by default. see io_net_set_label()
+#endif
 };
 
-struct __io_ssl_t
+// what plain TCP RX dispatch reads
+_Static_assert(offsetof(io_net_t, sd) + sizeof(int) <= IO_CACHE_LINE, "io_net_t hot fields exceed a cache line");
+
+//
+// last session negotiated with an endpoint. client side only
+//
+typedef struct
+{
+  in_addr_t                 addr;
+  uint16_t                  port;
+  uint8_t                   valid;
+  uint32_t                  last_used;
+  mbedtls_ssl_session       session;
+} io_ssl_client_session_t;
+
+//
+// server certificate and its private key.
+// mbedtls picks one per handshake according to the negotiated cipher suite
+//
+typedef struct
+{
+  mbedtls_x509_crt          crt;
+  mbedtls_pk_context        pkey;
+
+  // PEM/DER source of pkey. offload workers parse their own copy from this
+  const uint8_t*            key_src;
+  size_t                    key_src_len;
+
+  uint32_t                  handshakes;     // full handshakes served with this pair
+} io_ssl_cert_t;
+
+//
+// TLS configuration shared by many connections.
+// initialized once with io_ssl_ctx_init_server()/io_ssl_ctx_init_client()
+// and must outlive every connection referencing it.
+//
+struct __io_ssl_ctx_t
 {
-  mbedtls_net_context       mbed_fd;
   mbedtls_x509_crt          cacert;
   mbedtls_ssl_config        conf;
-  mbedtls_ssl_context       ssl;
   mbedtls_entropy_context   entropy;
-  mbedtls_pk_context        pkey;
   mbedtls_ctr_drbg_context  ctr_drbg;
 
-  uint8_t                   handshaking;
+  int                       endpoint;
+
+  io_ssl_cert_t             certs[IO_SSL_MAX_CERTS];
+  int                       num_certs;
+  int*                      ciphersuites;   // server preference. ECDSA first
+  int                       num_ciphersuites;
+
+#if defined(MBEDTLS_SSL_CACHE_C)
+  mbedtls_ssl_cache_context cache;
+#endif
+#if defined(MBEDTLS_SSL_TICKET_C)
+  mbedtls_ssl_ticket_context ticket;
+#endif
+
+  io_ssl_client_session_t   sessions[IO_SSL_CLIENT_SESSIONS];
+  uint32_t                  session_clock;
+
+  //
+  // handshake private key operations are run on this pool if set.
+  // each worker of the pool gets its own slot here and parses
+  // its own copy of the keys from key_src of certs
+  //
+  io_offload_t*             offload;
+  struct __io_ssl_worker_t* workers[IO_OFFLOAD_MAX_THREADS];
+  int                       num_workers;
+  struct list_head          offload_ops;    // submitted and not done yet
+
+  // hand record crypto to kernel TLS after handshake if possible
+  uint8_t                   ktls;
+
+  //
+  // handshake admission. see IO_SSL_HS_XXX
+  //
+  int                       hs_max_active;
+  int                       hs_max_queued;
+  uint32_t                  hs_budget_us;
 
+  int                       hs_active;
+  int                       hs_queued;
+  struct list_head          hs_queue;       // io_ssl_t waiting for a slot
+  uint32_t                  hs_loop;        // loop iteration hs_spent_us belongs to
+  uint32_t                  hs_spent_us;
+
+  // statistics
+  uint32_t                  full_handshakes;
+  uint32_t                  resumed_handshakes;
+  uint32_t                  offloaded_ops;
+  uint32_t                  ktls_connections;
+  uint32_t                  hs_queue_peak;
+  uint32_t                  hs_waited;          // admitted after waiting in queue
+  uint64_t                  hs_wait_total_us;
+  uint32_t                  hs_wait_max_us;
+  uint32_t                  hs_rejected;        // closed right after accept. queue full
+  uint32_t                  hs_budget_deferred; // handshake steps pushed to next loop
+  uint32_t                  hs_arena_peak;      // max of per handshake arena peak in bytes
+};
+
+typedef enum
+{
+  io_ssl_hs_state_none,         // not subject to admission
+  io_ssl_hs_state_queued,       // accepted. waiting for a handshake slot
+  io_ssl_hs_state_active,       // holding a handshake slot
+} io_ssl_hs_state_t;
+
+//
+// per connection TLS state
+//
+struct __io_ssl_t
+{
+  //
+  // hot. checked on every event before mbedtls is entered
+  //
   io_net_t*                 n;
+  io_ssl_ctx_t*             ctx;
+
+  uint8_t                   handshaking;
+  uint8_t                   resumed;
+  uint8_t                   ktls_rx;        // kernel decrypts. plain read path
+  uint8_t                   ktls_tx;        // kernel encrypts. plain write path
+  uint8_t                   hs_state;       // io_ssl_hs_state_t
+
+  uint16_t                  rec_small;      // record payload fitting in one segment. 0 for no limit
+  uint32_t                  rec_streak;     // bytes sent since last idle period
+  uint64_t                  rec_last_tx;    // usec
+
+  //
+  // plain text waiting behind a record mbedtls could not send completely.
+  // optional. set by user with io_ssl_set_tx_buf()
+  //
+  circ_buffer_t             txq;
+
+  // scheduled when RX budget runs out with plain text still buffered in mbedtls
+  io_driver_deferred_t      rx_more;
+
+  //
+  // cold. mbedtls state, kilobytes. only mbedtls itself walks through it
+  //
+  mbedtls_net_context       mbed_fd;
+  mbedtls_ssl_context       ssl;
+
+  io_ssl_ktls_keys_t*       ktls_keys;      // only between key export and handshake done
+
+  struct list_head          hs_le;          // in ctx->hs_queue while queued
+  uint64_t                  hs_queued_at;   // usec
+
+  in_addr_t                 peer_addr;      // client side session lookup key
+  uint16_t                  peer_port;
+
+#if defined(IO_SSL_ARENA)
+  //
+  // every mbedtls allocation of this connection. see io_ssl_arena.h
+  //
+  io_ssl_arena_t            arena;
+  uint32_t                  hs_peak_bytes;  // arena peak during handshake
+#endif
 };
 
-extern int io_net_bind(io_driver_t* driver, io_net_t* n, io_ssl_t* s, int port, io_net_callback cb);
-extern int io_net_connect(io_driver_t* driver, io_net_t* n, io_ssl_t* s, const char* ip_addr, int port, io_net_callback cb);
+_Static_assert(offsetof(io_ssl_t, txq) <= IO_CACHE_LINE, "io_ssl_t hot fields exceed a cache line");
+
+#define IO_NET_MEM_PAUSED_CONN          0x01      // over connection limit
+#define IO_NET_MEM_PAUSED_GLOBAL        0x02      // grew under global pressure
+
+typedef struct
+{
+  uint32_t                  conn_limit;
+  uint64_t                  global_limit;
+
+  uint64_t                  total;          // bytes held by all connections of the driver
+  uint8_t                   pressure;
+  uint8_t                   pressure_new;   // idle connections not told yet
+  struct list_head          conns;
+  io_driver_deferred_t      shed;           // delivers accounting events out of callbacks
+
+  // statistics
+  uint64_t                  peak;
+  uint32_t                  paused;         // times reads were paused
+  uint32_t                  rejected;       // accepts refused under pressure
+  uint32_t                  pressure_events;
+} io_net_mem_t;
+
+extern int io_ssl_ctx_init_server(io_ssl_ctx_t* ctx);
+extern int io_ssl_ctx_init_client(io_ssl_ctx_t* ctx);
+extern void io_ssl_ctx_deinit(io_ssl_ctx_t* ctx);
+extern int io_ssl_ctx_enable_offload(io_ssl_ctx_t* ctx, io_offload_t* offload);
+extern int io_ssl_ctx_enable_ktls(io_ssl_ctx_t* ctx);
+extern int io_ssl_ctx_add_cert(io_ssl_ctx_t* ctx, const uint8_t* crt, size_t crt_len,
+    const uint8_t* key, size_t key_len);
+extern void io_ssl_ctx_set_ciphersuites(io_ssl_ctx_t* ctx, const int* ciphersuites);
+extern int io_ssl_ctx_set_max_frag_len(io_ssl_ctx_t* ctx, uint8_t mfl_code);
+extern void io_ssl_ctx_set_handshake_limits(io_ssl_ctx_t* ctx, int max_active, int max_queued, uint32_t budget_us);
+
+extern int io_net_bind(io_driver_t* driver, io_net_t* n, io_ssl_ctx_t* ctx, int port, io_net_callback cb);
+extern int io_net_connect(io_driver_t* driver, io_net_t* n, io_ssl_ctx_t* ctx, io_ssl_t* s,
+    const char* ip_addr, int port, io_net_callback cb);
 extern void io_net_close(io_net_t* n);
 
 extern int io_net_tx(io_net_t* n, uint8_t* buf, int len);
+extern int io_net_sendfile(io_net_t* n, int in_fd, off_t* offset, int count);
 
 extern int io_net_udp(io_driver_t* driver, io_net_t* n, int port, io_net_callback cb);
 extern int io_net_udp_tx(io_net_t* n, struct sockaddr_in* to, uint8_t* buf, int len);
+extern int io_net_udp_set_bufs(io_net_t* n, int rcvbuf, int sndbuf);
 
+extern int io_net_set_rx_adaptive(io_net_t* n, int min_size, int max_size);
+extern void io_net_set_label(io_net_t* n, const char* label);
+
+extern void io_net_tcp_info_set_interval(uint32_t msec);
+extern void io_net_tcp_info_attach(io_net_t* n, io_net_tcp_hist_t* h);
+extern int io_net_tcp_info_sample(io_net_t* n);
+extern void io_net_tcp_hist_init(io_net_tcp_hist_t* h);
+extern void io_net_tcp_hist_dump(const io_net_tcp_hist_t* h);
+extern void io_net_rx_pool_dump(io_driver_t* driver);
+
+extern int io_net_mem_set_limits(io_driver_t* driver, uint32_t conn_limit, uint64_t global_limit);
+extern void io_net_mem_charge(io_net_t* n, int delta);
+extern void io_net_mem_update(io_net_t* n);
+extern const io_net_mem_t* io_net_mem_stats(io_driver_t* driver);
+extern const io_net_stats_t* io_net_stats(io_driver_t* driver);
+
+//
+// can be called any time on a connection not in adaptive rx mode, including
+// before io_net_connect() and on io_net_event_enum_alloc_connection.
+// whatever is set then is accounted when the connection is attached,
+// so io_net_t should be zeroed when allocated
+//
 static inline void
 io_net_set_rx_buf(io_net_t* n, uint8_t* rx_buf, int rx_size)
 {
   n->rx_buf   = rx_buf;
   n->rx_size  = rx_size;
+
+  io_net_mem_update(n);
+}
+
+//
+// should be called after io_net_connect() or on io_net_event_enum_connected
+//
+static inline void
+io_ssl_set_tx_buf(io_ssl_t* s, uint8_t* tx_buf, int tx_size)
+{
+  circ_buffer_init_with_mem(&s->txq, tx_buf, tx_size);
+
+  io_net_mem_update(s->n);
 }
 
 #endif /* !__IO_NET_DEF_H__ */
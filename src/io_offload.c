@@ -0,0 +1,220 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+
+#include "io_offload.h"
+
+static const char* TAG = "io_offload";
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// worker thread
+//
+///////////////////////////////////////////////////////////////////////////////
+static void*
+io_offload_worker(void* arg)
+{
+  io_offload_t*       o = (io_offload_t*)arg;
+  io_offload_job_t*   job;
+  uint64_t            v = 1;
+  int                 ndx;
+
+  pthread_mutex_lock(&o->lock);
+
+  ndx = o->num_started++;
+
+  while(1)
+  {
+    while(!o->stop && list_empty(&o->pending))
+    {
+      pthread_cond_wait(&o->cond, &o->lock);
+    }
+
+    if(o->stop)
+    {
+      break;
+    }
+
+    job = list_first_entry(&o->pending, io_offload_job_t, le);
+    list_del_init(&job->le);
+    job->state  = io_offload_job_running;
+    job->worker = ndx;
+
+    pthread_mutex_unlock(&o->lock);
+
+    job->work(job);
+
+    pthread_mutex_lock(&o->lock);
+    job->state = io_offload_job_completed;
+    list_add_tail(&job->le, &o->completed);
+    pthread_cond_broadcast(&o->job_done);
+
+    // wake up io_driver thread
+    if(write(o->efd, &v, sizeof(v)) != sizeof(v))
+    {
+      LOGE(TAG, "%s eventfd write failed\n", __func__);
+    }
+  }
+
+  pthread_mutex_unlock(&o->lock);
+  return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// I/O driver callbacks
+//
+///////////////////////////////////////////////////////////////////////////////
+static void
+io_offload_completion_callback(io_driver_watcher_t* w, io_driver_event e)
+{
+  io_offload_t*       o = container_of(w, io_offload_t, watcher);
+  io_offload_job_t*   job;
+  struct list_head    done_list;
+  uint64_t            v;
+
+  if(read(o->efd, &v, sizeof(v)) != sizeof(v))
+  {
+    return;
+  }
+
+  INIT_LIST_HEAD(&done_list);
+
+  pthread_mutex_lock(&o->lock);
+  list_splice_init(&o->completed, &done_list);
+  pthread_mutex_unlock(&o->lock);
+
+  while(!list_empty(&done_list))
+  {
+    job = list_first_entry(&done_list, io_offload_job_t, le);
+    list_del_init(&job->le);
+    job->state = io_offload_job_idle;
+
+    o->finished++;
+    job->done(job);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+///////////////////////////////////////////////////////////////////////////////
+int
+io_offload_init(io_driver_t* driver, io_offload_t* o, int num_threads)
+{
+  num_threads = MIN(num_threads, IO_OFFLOAD_MAX_THREADS);
+  if(num_threads <= 0)
+  {
+    return -1;
+  }
+
+  o->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if(o->efd < 0)
+  {
+    LOGE(TAG, "%s eventfd failed\n", __func__);
+    return -1;
+  }
+
+  pthread_mutex_init(&o->lock, NULL);
+  pthread_cond_init(&o->cond, NULL);
+  pthread_cond_init(&o->job_done, NULL);
+  INIT_LIST_HEAD(&o->pending);
+  INIT_LIST_HEAD(&o->completed);
+
+  o->driver       = driver;
+  o->stop         = FALSE;
+  o->num_threads  = 0;
+  o->num_started  = 0;
+  o->submitted    = 0;
+  o->finished     = 0;
+
+  for(int i = 0; i < num_threads; i++)
+  {
+    if(pthread_create(&o->threads[i], NULL, io_offload_worker, o) != 0)
+    {
+      LOGE(TAG, "%s pthread_create failed\n", __func__);
+      break;
+    }
+    o->num_threads++;
+  }
+
+  if(o->num_threads == 0)
+  {
+    pthread_cond_destroy(&o->job_done);
+    pthread_cond_destroy(&o->cond);
+    pthread_mutex_destroy(&o->lock);
+    close(o->efd);
+    return -1;
+  }
+
+  io_driver_watcher_init(&o->watcher, o->efd, io_offload_completion_callback);
+#if defined(IO_DRIVER_METRICS)
+  io_driver_watcher_stat_init(&o->watcher, &o->stat, "io_offload");
+#endif
+  io_driver_watch(driver, &o->watcher, IO_DRIVER_EVENT_RX);
+
+  return 0;
+}
+
+//
+// jobs not yet completed are dropped without done callback
+//
+void
+io_offload_deinit(io_offload_t* o)
+{
+  pthread_mutex_lock(&o->lock);
+  o->stop = TRUE;
+  pthread_cond_broadcast(&o->cond);
+  pthread_mutex_unlock(&o->lock);
+
+  for(int i = 0; i < o->num_threads; i++)
+  {
+    pthread_join(o->threads[i], NULL);
+  }
+
+  io_driver_no_watch(o->driver, &o->watcher, IO_DRIVER_EVENT_RX);
+  close(o->efd);
+
+  pthread_cond_destroy(&o->job_done);
+  pthread_cond_destroy(&o->cond);
+  pthread_mutex_destroy(&o->lock);
+}
+
+void
+io_offload_submit(io_offload_t* o, io_offload_job_t* job)
+{
+  o->submitted++;
+
+  pthread_mutex_lock(&o->lock);
+  job->state = io_offload_job_pending;
+  list_add_tail(&job->le, &o->pending);
+  pthread_cond_signal(&o->cond);
+  pthread_mutex_unlock(&o->lock);
+}
+
+//
+// takes a submitted job back. waits for the worker if it is running.
+// done callback is never called for the job afterwards.
+// must be called on io_driver thread
+//
+void
+io_offload_cancel(io_offload_t* o, io_offload_job_t* job)
+{
+  pthread_mutex_lock(&o->lock);
+
+  while(job->state == io_offload_job_running)
+  {
+    pthread_cond_wait(&o->job_done, &o->lock);
+  }
+
+  if(job->state != io_offload_job_idle)
+  {
+    list_del_init(&job->le);
+    job->state = io_offload_job_idle;
+    o->finished++;
+  }
+
+  pthread_mutex_unlock(&o->lock);
+}
@@ -0,0 +1,82 @@
+//
+// a tiny worker thread pool for CPU heavy jobs.
+// jobs run on worker threads and their completion is posted back
+// to the io_driver thread through an eventfd.
+//
+#ifndef __IO_OFFLOAD_DEF_H__
+#define __IO_OFFLOAD_DEF_H__
+
+#include <pthread.h>
+#include "io_driver.h"
+
+#define IO_OFFLOAD_MAX_THREADS          16
+
+struct __io_offload_job_t;
+typedef struct __io_offload_job_t io_offload_job_t;
+
+//
+// work is called on a worker thread.
+// done is called on io_driver thread after work is finished
+//
+typedef void (*io_offload_work_callback)(io_offload_job_t* job);
+typedef void (*io_offload_done_callback)(io_offload_job_t* job);
+
+typedef enum
+{
+  io_offload_job_idle,
+  io_offload_job_pending,
+  io_offload_job_running,
+  io_offload_job_completed,
+} io_offload_job_state_t;
+
+struct __io_offload_job_t
+{
+  struct list_head            le;
+  io_offload_work_callback    work;
+  io_offload_done_callback    done;
+  io_offload_job_state_t      state;        // changed under lock of the pool
+  int                         worker;       // index of the worker running it. 0 ~ num_threads - 1
+};
+
+typedef struct
+{
+  io_driver_t*          driver;
+  io_driver_watcher_t   watcher;
+  int                   efd;
+#if defined(IO_DRIVER_METRICS)
+  io_driver_watcher_stat_t  stat;
+#endif
+
+  pthread_mutex_t       lock;
+  pthread_cond_t        cond;
+  pthread_cond_t        job_done;         // for io_offload_cancel()
+  struct list_head      pending;          // waiting for a worker
+  struct list_head      completed;        // waiting for done callback
+
+  pthread_t             threads[IO_OFFLOAD_MAX_THREADS];
+  int                   num_threads;
+  int                   num_started;      // worker index dispenser
+  bool                  stop;
+
+  // statistics. updated on io_driver thread
+  uint32_t              submitted;
+  uint32_t              finished;
+} io_offload_t;
+
+extern int io_offload_init(io_driver_t* driver, io_offload_t* o, int num_threads);
+extern void io_offload_deinit(io_offload_t* o);
+extern void io_offload_submit(io_offload_t* o, io_offload_job_t* job);
+extern void io_offload_cancel(io_offload_t* o, io_offload_job_t* job);
+
+static inline void
+io_offload_job_init(io_offload_job_t* job, io_offload_work_callback work, io_offload_done_callback done)
+{
+  INIT_LIST_HEAD(&job->le);
+
+  job->work   = work;
+  job->done   = done;
+  job->state  = io_offload_job_idle;
+  job->worker = -1;
+}
+
+#endif /* !__IO_OFFLOAD_DEF_H__ */
@@ -152,6 +152,10 @@ io_pipe_init(io_driver_t* driver, io_pipe_t* p, io_pipe_callback cb,
 
   io_driver_watcher_init(&p->rw, p->pipe_r, io_pipe_rx_callback);
   io_driver_watcher_init(&p->tw, p->pipe_w, io_pipe_tx_callback);
+#if defined(IO_DRIVER_METRICS)
+  io_driver_watcher_stat_init(&p->rw, &p->rstat, "pipe:rx");
+  io_driver_watcher_stat_init(&p->tw, &p->tstat, "pipe:tx");
+#endif
 
   io_driver_watch(driver, &p->rw, IO_DRIVER_EVENT_RX);
   return 0;
@@ -38,6 +38,10 @@ struct __io_pipe_t
 
   io_driver_watcher_t rw;
   io_driver_watcher_t tw;
+#if defined(IO_DRIVER_METRICS)
+  io_driver_watcher_stat_t  rstat;
+  io_driver_watcher_stat_t  tstat;
+#endif
 
   io_driver_t*        driver;
 
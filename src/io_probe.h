@@ -0,0 +1,43 @@
+//
+// USDT static tracepoints.
+//
+// with systemtap sdt header installed (systemtap-sdt-dev, systemtap-sdt-devel),
+// each probe is a single nop in the hot path and a note in the ELF file.
+// nothing is evaluated unless a tracer is attached. without the header,
+// or with IO_DRIVER_NO_USDT, probes compile to nothing.
+//
+// providers and probes
+//   io_driver:dispatch_start(fd, mask)    io_driver:dispatch_done(fd, mask)
+//   io_driver:poll_start(maxfd)           io_driver:poll_done(ready)
+//   io_net:rx(fd, bytes)                  io_net:tx(fd, bytes, written)
+//   io_net:accept(listen fd, fd)          io_net:close(fd)
+//   io_net:hs_step(fd, state, ret)        io_net:hs_done(fd, resumed)
+//   soft_timer:tick(tick)                 soft_timer:expire(callback, elem)
+//
+// e.g. callback latency per fd
+//   bpftrace -e 'usdt:./libiodriver.a:io_driver:dispatch_start { @s[tid] = nsecs; }
+//                usdt:./libiodriver.a:io_driver:dispatch_done /@s[tid]/
+//                { @us[arg0] = hist((nsecs - @s[tid]) / 1000); delete(@s[tid]); }'
+// attach to the executable linking the library.
+//
+#ifndef __IO_PROBE_DEF_H__
+#define __IO_PROBE_DEF_H__
+
+#if !defined(IO_DRIVER_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define IO_DRIVER_USDT
+#endif
+#endif
+
+#if defined(IO_DRIVER_USDT)
+#define IO_PROBE1(provider, name, a1)                   DTRACE_PROBE1(provider, name, a1)
+#define IO_PROBE2(provider, name, a1, a2)               DTRACE_PROBE2(provider, name, a1, a2)
+#define IO_PROBE3(provider, name, a1, a2, a3)           DTRACE_PROBE3(provider, name, a1, a2, a3)
+#else
+#define IO_PROBE1(provider, name, a1)                   do { } while(0)
+#define IO_PROBE2(provider, name, a1, a2)               do { } while(0)
+#define IO_PROBE3(provider, name, a1, a2, a3)           do { } while(0)
+#endif
+
+#endif /* !__IO_PROBE_DEF_H__ */
@@ -0,0 +1,266 @@
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(MBEDTLS_CONFIG_FILE)
+#include "mbedtls/config.h"
+#else
+#include MBEDTLS_CONFIG_FILE
+#endif
+
+#include "mbedtls/platform.h"
+
+#include "io_ssl_arena.h"
+#include "io_alloc.h"
+
+static const char* TAG = "io_ssl_arena";
+
+#define IO_SSL_ARENA_LARGE          0xfe      // too big for a class. from arena allocator
+#define IO_SSL_ARENA_HEAP           0xff      // outside any arena. from heap allocator
+
+//
+// 16 bytes to keep returned blocks 16 byte aligned
+//
+typedef struct
+{
+  void*             owner;          // io_ssl_arena_t or io_allocator_t for heap blocks
+  uint32_t          size;           // requested size
+  uint32_t          cls;            // size class or IO_SSL_ARENA_LARGE/HEAP
+} __attribute__((aligned(16))) io_ssl_arena_hdr_t;
+
+static __thread io_ssl_arena_t*   _current;
+static __thread io_allocator_t*   _heap;        // NULL for default allocator
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// utilities
+//
+///////////////////////////////////////////////////////////////////////////////
+static inline int
+io_ssl_arena_class(size_t size)
+{
+  int     cls = 0;
+  size_t  csize = 1 << IO_SSL_ARENA_MIN_SHIFT;
+
+  while(csize < size)
+  {
+    csize <<= 1;
+    cls++;
+  }
+  return cls < IO_SSL_ARENA_CLASSES ? cls : IO_SSL_ARENA_LARGE;
+}
+
+static inline size_t
+io_ssl_arena_class_size(int cls)
+{
+  return sizeof(io_ssl_arena_hdr_t) + ((size_t)1 << (cls + IO_SSL_ARENA_MIN_SHIFT));
+}
+
+static io_ssl_arena_hdr_t*
+io_ssl_arena_carve(io_ssl_arena_t* a, int cls)
+{
+  size_t                bsize = io_ssl_arena_class_size(cls);
+  uint8_t*              chunk;
+  io_ssl_arena_hdr_t*   h;
+
+  if(a->free_list[cls] != NULL)
+  {
+    h = a->free_list[cls];
+    a->free_list[cls] = *(void**)&h[1];
+    return h;
+  }
+
+  if(a->left < bsize)
+  {
+    // tail of current chunk is wasted
+    chunk = io_alloc(a->allocator, io_alloc_tls, IO_SSL_ARENA_CHUNK);
+    if(chunk == NULL)
+    {
+      return NULL;
+    }
+
+    *(uint8_t**)chunk = a->chunks;
+    a->chunks = chunk;
+
+    a->cur      = chunk + sizeof(io_ssl_arena_hdr_t);
+    a->left     = IO_SSL_ARENA_CHUNK - sizeof(io_ssl_arena_hdr_t);
+    a->reserved += IO_SSL_ARENA_CHUNK;
+  }
+
+  h = (io_ssl_arena_hdr_t*)a->cur;
+  a->cur  += bsize;
+  a->left -= bsize;
+
+  return h;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// mbedtls platform hooks
+//
+///////////////////////////////////////////////////////////////////////////////
+static void*
+io_ssl_arena_calloc(size_t n, size_t size)
+{
+  io_ssl_arena_t*       a = _current;
+  io_allocator_t*       heap = _heap != NULL ? _heap : io_allocator_default();
+  io_ssl_arena_hdr_t*   h;
+  size_t                total;
+  int                   cls;
+
+  if(size != 0 && n > (UINT32_MAX / size))
+  {
+    return NULL;
+  }
+  total = n * size;
+
+  if(a == NULL)
+  {
+    cls = IO_SSL_ARENA_HEAP;
+    h = io_alloc(heap, io_alloc_tls, sizeof(io_ssl_arena_hdr_t) + total);
+  }
+  else if((cls = io_ssl_arena_class(total)) == IO_SSL_ARENA_LARGE)
+  {
+    h = io_alloc(a->allocator, io_alloc_tls, sizeof(io_ssl_arena_hdr_t) + total);
+  }
+  else
+  {
+    h = io_ssl_arena_carve(a, cls);
+  }
+
+  if(h == NULL)
+  {
+    return NULL;
+  }
+
+  h->owner  = a != NULL ? (void*)a : (void*)heap;
+  h->size   = (uint32_t)total;
+  h->cls    = cls;
+
+  if(a != NULL)
+  {
+    a->in_use += total;
+    if(a->in_use > a->peak)
+    {
+      a->peak = a->in_use;
+    }
+  }
+
+  memset(&h[1], 0, total);
+  return &h[1];
+}
+
+static void
+io_ssl_arena_free(void* p)
+{
+  io_ssl_arena_hdr_t*   h;
+  io_ssl_arena_t*       a;
+
+  if(p == NULL)
+  {
+    return;
+  }
+
+  h = (io_ssl_arena_hdr_t*)p - 1;
+
+  if(h->cls == IO_SSL_ARENA_HEAP)
+  {
+    io_free(h->owner, io_alloc_tls, h, sizeof(io_ssl_arena_hdr_t) + h->size);
+    return;
+  }
+
+  a = h->owner;
+  a->in_use -= h->size;
+
+  if(h->cls == IO_SSL_ARENA_LARGE)
+  {
+    io_free(a->allocator, io_alloc_tls, h, sizeof(io_ssl_arena_hdr_t) + h->size);
+    return;
+  }
+
+  *(void**)p = a->free_list[h->cls];
+  a->free_list[h->cls] = h;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//
+// must be called before anything is allocated by mbedtls
+//
+int
+io_ssl_arena_install(void)
+{
+#if defined(MBEDTLS_PLATFORM_MEMORY) && !defined(MBEDTLS_PLATFORM_CALLOC_MACRO)
+  static bool   installed = FALSE;
+
+  if(!installed)
+  {
+    mbedtls_platform_set_calloc_free(io_ssl_arena_calloc, io_ssl_arena_free);
+    installed = TRUE;
+  }
+  return 0;
+#else
+  LOGE(TAG, "%s mbedtls built without MBEDTLS_PLATFORM_MEMORY\n", __func__);
+  return -1;
+#endif
+}
+
+void
+io_ssl_arena_init(io_ssl_arena_t* a, io_allocator_t* allocator)
+{
+  memset(a, 0, sizeof(io_ssl_arena_t));
+
+  a->allocator = allocator;
+}
+
+//
+// gives chunks back once every block is freed.
+// blocks still in use mean mbedtls memory was routed to the wrong arena.
+// chunks are leaked then rather than left under live blocks
+//
+void
+io_ssl_arena_release(io_ssl_arena_t* a)
+{
+  uint8_t*          chunk;
+  io_allocator_t*   allocator = a->allocator;
+
+  if(a->in_use != 0)
+  {
+    LOGE(TAG, "%s arena released with %zu bytes in use. leaking %zu bytes\n",
+        __func__, a->in_use, a->reserved);
+    io_ssl_arena_init(a, allocator);
+    return;
+  }
+
+  while(a->chunks != NULL)
+  {
+    chunk = a->chunks;
+    a->chunks = *(uint8_t**)chunk;
+    io_free(allocator, io_alloc_tls, chunk, IO_SSL_ARENA_CHUNK);
+  }
+
+  io_ssl_arena_init(a, allocator);
+}
+
+void
+io_ssl_arena_enter(io_ssl_arena_scope_t* saved, io_ssl_arena_t* a, io_allocator_t* heap)
+{
+  saved->arena  = _current;
+  saved->heap   = _heap;
+
+  _current = a;
+  if(heap != NULL)
+  {
+    _heap = heap;
+  }
+}
+
+void
+io_ssl_arena_leave(io_ssl_arena_scope_t* saved)
+{
+  _current  = saved->arena;
+  _heap     = saved->heap;
+}
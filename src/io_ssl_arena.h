@@ -0,0 +1,73 @@
+//
+// per connection arena for mbedtls allocations.
+//
+// mbedtls calloc/free are routed through io_ssl_arena hooks.
+// while an arena is switched in, small allocations are carved out of
+// arena chunks and recycled through size class free lists.
+// chunks are returned to the heap all at once when the connection goes away,
+// so a long running connection doesn't leave small holes all over the heap.
+//
+// every block carries a small header telling where it came from,
+// so a block can be freed no matter which arena is switched in.
+//
+// arena memory comes from the allocator given to io_ssl_arena_init().
+// mbedtls allocations outside any arena go to the heap allocator
+// switched in with the arena, the default io_allocator if none.
+// both are accounted as io_alloc_tls.
+//
+#ifndef __IO_SSL_ARENA_DEF_H__
+#define __IO_SSL_ARENA_DEF_H__
+
+#include <stddef.h>
+#include "common_def.h"
+#include "io_alloc.h"
+
+#ifndef IO_SSL_ARENA_CHUNK
+#define IO_SSL_ARENA_CHUNK              8192      // unit of heap allocation
+#endif
+
+#define IO_SSL_ARENA_MIN_SHIFT          4         // smallest class. 16 bytes
+#define IO_SSL_ARENA_CLASSES            8         // 16 .. 2048. bigger ones go to heap directly
+
+typedef struct
+{
+  io_allocator_t* allocator;
+  uint8_t*      chunks;             // singly linked through the first word of each chunk
+  uint8_t*      cur;
+  size_t        left;
+  void*         free_list[IO_SSL_ARENA_CLASSES];
+
+  // statistics
+  size_t        in_use;             // bytes requested and not yet freed
+  size_t        peak;
+  size_t        reserved;           // bytes taken from heap in chunks
+} io_ssl_arena_t;
+
+extern int io_ssl_arena_install(void);
+extern void io_ssl_arena_init(io_ssl_arena_t* a, io_allocator_t* allocator);
+extern void io_ssl_arena_release(io_ssl_arena_t* a);
+
+//
+// what mbedtls allocations of a thread go to
+//
+typedef struct
+{
+  io_ssl_arena_t*   arena;
+  io_allocator_t*   heap;
+} io_ssl_arena_scope_t;
+
+//
+// switches in arena a and heap allocator for mbedtls allocations of calling thread.
+// NULL arena allocates from heap. NULL heap keeps the current one.
+// previous scope is saved for io_ssl_arena_leave()
+//
+extern void io_ssl_arena_enter(io_ssl_arena_scope_t* saved, io_ssl_arena_t* a, io_allocator_t* heap);
+extern void io_ssl_arena_leave(io_ssl_arena_scope_t* saved);
+
+static inline void
+io_ssl_arena_reset_peak(io_ssl_arena_t* a)
+{
+  a->peak = a->in_use;
+}
+
+#endif /* !__IO_SSL_ARENA_DEF_H__ */
@@ -0,0 +1,193 @@
+#include <string.h>
+#include <pthread.h>
+
+#include "io_static.h"
+
+#if defined(IO_DRIVER_STATIC)
+
+static const char* TAG = "io_static";
+
+#define IO_STATIC_POOL_MEM(bs, cnt)                                             \
+  static uint8_t _pool_mem_##bs[(bs) * (cnt)] __attribute__((aligned(16)));
+
+#define IO_STATIC_POOL_ENTRY(bs, cnt)                                           \
+  { .bsize = (bs), .count = (cnt), .mem = _pool_mem_##bs },
+
+IO_STATIC_POOLS(IO_STATIC_POOL_MEM)
+
+static io_static_pool_t   _pools[] =
+{
+  IO_STATIC_POOLS(IO_STATIC_POOL_ENTRY)
+};
+
+static io_allocator_t     _static_allocator;
+static bool               _initialized = FALSE;
+
+// pools are shared by io_driver thread and offload workers through mbedtls
+static pthread_mutex_t    _lock = PTHREAD_MUTEX_INITIALIZER;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// utilities
+//
+///////////////////////////////////////////////////////////////////////////////
+static void
+io_static_pool_init(io_static_pool_t* p)
+{
+  p->free_list  = NULL;
+  p->used       = 0;
+  p->peak       = 0;
+  p->failed     = 0;
+
+  for(int i = p->count - 1; i >= 0; i--)
+  {
+    *(void**)&p->mem[i * p->bsize] = p->free_list;
+    p->free_list = &p->mem[i * p->bsize];
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// io_allocator backend
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//
+// smallest pool with a free block. larger pools are borrowed from
+// when a pool runs dry
+//
+static void*
+io_static_alloc(void* arg, size_t size)
+{
+  io_static_pool_t*   p;
+  void*               b = NULL;
+
+  pthread_mutex_lock(&_lock);
+
+  for(int i = 0; i < NARRAY(_pools); i++)
+  {
+    p = &_pools[i];
+
+    if(p->bsize < size)
+    {
+      continue;
+    }
+
+    if(p->free_list == NULL)
+    {
+      p->failed++;
+      continue;
+    }
+
+    b = p->free_list;
+    p->free_list = *(void**)b;
+
+    p->used++;
+    if(p->used > p->peak)
+    {
+      p->peak = p->used;
+    }
+    break;
+  }
+
+  pthread_mutex_unlock(&_lock);
+  return b;
+}
+
+static void
+io_static_free(void* arg, void* b, size_t size)
+{
+  io_static_pool_t*   p;
+
+  pthread_mutex_lock(&_lock);
+
+  for(int i = 0; i < NARRAY(_pools); i++)
+  {
+    p = &_pools[i];
+
+    if((uint8_t*)b >= p->mem && (uint8_t*)b < &p->mem[p->bsize * p->count])
+    {
+      *(void**)b = p->free_list;
+      p->free_list = b;
+      p->used--;
+      break;
+    }
+  }
+
+  pthread_mutex_unlock(&_lock);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//
+// called by io_driver_init(). call it yourself first
+// if anything is allocated before io_driver_init()
+//
+void
+io_static_init(void)
+{
+  if(_initialized)
+  {
+    return;
+  }
+
+  for(int i = 0; i < NARRAY(_pools); i++)
+  {
+    io_static_pool_init(&_pools[i]);
+  }
+
+  io_allocator_init(&_static_allocator, io_static_alloc, io_static_free, NULL);
+  io_allocator_set_default(&_static_allocator);
+
+  _initialized = TRUE;
+}
+
+size_t
+io_static_footprint(void)
+{
+  size_t  total = 0;
+
+  for(int i = 0; i < NARRAY(_pools); i++)
+  {
+    total += (size_t)_pools[i].bsize * _pools[i].count;
+  }
+  return total;
+}
+
+void
+io_static_dump(void)
+{
+  io_static_pool_t*   p;
+
+  for(int i = 0; i < NARRAY(_pools); i++)
+  {
+    p = &_pools[i];
+    LOGI(TAG, "pool %6u x %4u = %8zu bytes. used %u, peak %u, failed %u\n",
+        p->bsize, p->count, (size_t)p->bsize * p->count, p->used, p->peak, p->failed);
+  }
+  LOGI(TAG, "total %zu bytes\n", io_static_footprint());
+}
+
+#else /* !IO_DRIVER_STATIC */
+
+void
+io_static_init(void)
+{
+}
+
+size_t
+io_static_footprint(void)
+{
+  return 0;
+}
+
+void
+io_static_dump(void)
+{
+}
+
+#endif /* IO_DRIVER_STATIC */
@@ -0,0 +1,63 @@
+//
+// static allocation build mode. built with make STATIC=1
+//
+// everything allocated through io_allocator, including mbedtls internals,
+// comes out of fixed block pools sized at compile time.
+// io_static_init() replaces the default io_allocator
+// and nothing goes to libc heap afterwards.
+//
+// watchers, timers and io_net/io_ssl objects are embedded in caller objects
+// and never allocated by the library. what is sized here is
+// what used to come from heap: connection objects of the application,
+// circ_buffer memory and mbedtls allocations.
+//
+#ifndef __IO_STATIC_DEF_H__
+#define __IO_STATIC_DEF_H__
+
+#include "io_alloc.h"
+
+#ifndef IO_STATIC_MAX_CONNECTIONS
+#define IO_STATIC_MAX_CONNECTIONS         16        // plain and TLS connections alive at once
+#endif
+
+#ifndef IO_STATIC_MAX_TLS_CONNECTIONS
+#define IO_STATIC_MAX_TLS_CONNECTIONS     4         // TLS connections alive at once
+#endif
+
+#ifndef IO_STATIC_TLS_BUF_SIZE
+#define IO_STATIC_TLS_BUF_SIZE            17408     // mbedtls record buffer with allocation header
+#endif
+
+//
+// block size, number of blocks.
+// mbedtls needs two record buffers and a bunch of small blocks per connection.
+// on top of that comes what the TLS contexts keep for their life time
+// (certificates, keys, session cache). tune with io_static_dump()
+//
+#define IO_STATIC_POOLS(X)                                                            \
+  X(32,                       256 + 64 * IO_STATIC_MAX_TLS_CONNECTIONS)               \
+  X(128,                      128 + 32 * IO_STATIC_MAX_TLS_CONNECTIONS)               \
+  X(512,                      64  + 16 * IO_STATIC_MAX_TLS_CONNECTIONS)               \
+  X(2048,                     16  + IO_STATIC_MAX_CONNECTIONS +                       \
+                                    4 * IO_STATIC_MAX_TLS_CONNECTIONS)                \
+  X(8192,                     4   + 2 * IO_STATIC_MAX_TLS_CONNECTIONS)                \
+  X(IO_STATIC_TLS_BUF_SIZE,   2 * IO_STATIC_MAX_TLS_CONNECTIONS)
+
+typedef struct
+{
+  uint32_t      bsize;
+  uint32_t      count;
+  uint8_t*      mem;
+  void*         free_list;
+
+  // statistics
+  uint32_t      used;
+  uint32_t      peak;
+  uint32_t      failed;
+} io_static_pool_t;
+
+extern void io_static_init(void);
+extern size_t io_static_footprint(void);
+extern void io_static_dump(void);
+
+#endif /* !__IO_STATIC_DEF_H__ */
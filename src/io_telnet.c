@@ -20,10 +20,17 @@ static const char* TAG = "telnet";
 // utilities
 //
 ///////////////////////////////////////////////////////////////////////////////
+//
+// a connection reads into an adaptive buffer so that a bulk paste doesn't take
+// dozens of reads. t->rx_buf is the fallback and the listener's buffer
+//
 static void
-io_telnet_connection_init(io_telnet_t* t)
+io_telnet_connection_init(io_telnet_t* t, bool adaptive)
 {
-  io_net_set_rx_buf(&t->n, t->rx_buf, IO_TELNET_RX_BUF_SIZE);
+  if(!adaptive || io_net_set_rx_adaptive(&t->n, IO_TELNET_RX_BUF_SIZE, IO_TELNET_RX_BUF_MAX) != 0)
+  {
+    io_net_set_rx_buf(&t->n, t->rx_buf, IO_TELNET_RX_BUF_SIZE);
+  }
 
   t->treader.databack = io_telnet_data_back;
   t->treader.cmdback  = io_telnet_cmd_back;
@@ -94,7 +101,7 @@ io_telnet_server_callback(io_net_t* n, io_net_event_t* e)
     ev.n    = NULL;
     ev.from = e->from;
 
-    io_telnet_connection_init(t);
+    io_telnet_connection_init(t, TRUE);
 
     return t->cb(t, &ev);
 
@@ -119,6 +126,13 @@ io_telnet_server_callback(io_net_t* n, io_net_event_t* e)
     ev.n  = NULL;
     return t->cb(t, &ev);
 
+  case io_net_event_enum_paused:
+  case io_net_event_enum_resumed:
+  case io_net_event_enum_mem_pressure:
+    ev.ev = e->ev;
+    ev.n  = NULL;
+    return t->cb(t, &ev);
+
   case io_net_event_enum_handshaken:
     // FIXME
     break;
@@ -156,7 +170,10 @@ io_telnet_client_callback(io_net_t* n, io_net_event_t* e)
     return t->cb(t, &ev);
 
   case io_net_event_enum_closed:
-    ev.ev = io_net_event_enum_closed;
+  case io_net_event_enum_paused:
+  case io_net_event_enum_resumed:
+  case io_net_event_enum_mem_pressure:
+    ev.ev = e->ev;
     ev.n  = NULL;
     return t->cb(t, &ev);
 
@@ -179,7 +196,7 @@ io_telnet_bind(io_driver_t* driver, io_telnet_t* t, int port, io_telnet_callback
     return -1;
   }
 
-  io_telnet_connection_init(t);
+  io_telnet_connection_init(t, FALSE);
   t->cb = cb;
   return 0;
 }
@@ -187,12 +204,12 @@ io_telnet_bind(io_driver_t* driver, io_telnet_t* t, int port, io_telnet_callback
 int
 io_telnet_connect(io_driver_t* driver, io_telnet_t* t, const char* ip_addr, int port, io_telnet_callback cb)
 {
-  if(io_net_connect(driver, &t->n, NULL, ip_addr, port, io_telnet_client_callback) != 0)
+  if(io_net_connect(driver, &t->n, NULL, NULL, ip_addr, port, io_telnet_client_callback) != 0)
   {
     return -1;
   }
 
-  io_telnet_connection_init(t);
+  io_telnet_connection_init(t, TRUE);
   t->cb = cb;
 
   return 0;
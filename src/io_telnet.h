@@ -5,6 +5,7 @@
 #include "telnet_reader.h"
 
 #define IO_TELNET_RX_BUF_SIZE       128
+#define IO_TELNET_RX_BUF_MAX        4096      // adaptive rx buffer limit
 #define IO_TELNET_TX_BUF_SIZE       256
 
 struct __io_telnet_t;
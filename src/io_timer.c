@@ -7,12 +7,37 @@
 #include <sys/timerfd.h>
 
 #include "io_timer.h"
+#include "io_watchdog.h"
+#include "io_trace.h"
 
 ///////////////////////////////////////////////////////////////////////////////
 //
 // I/O driver callbacks
 //
 ///////////////////////////////////////////////////////////////////////////////
+
+//
+// every soft timer callback is watched on its own
+//
+static void
+io_timer_run(SoftTimer* st, SoftTimerElem* e)
+{
+  io_timer_t*           t = container_of(st, io_timer_t, st);
+  io_watchdog_frame_t   f;
+
+  IO_TRACE(t->driver, io_trace_timer, 0, 0, st->tick);
+
+  if(t->driver->watchdog == NULL)
+  {
+    e->cb(e);
+    return;
+  }
+
+  io_watchdog_enter(t->driver->watchdog, &f, (void*)e->cb, "soft_timer");
+  e->cb(e);
+  io_watchdog_leave(t->driver->watchdog, &f);
+}
+
 static void
 io_timer_tick_callback(io_driver_watcher_t* w, io_driver_event e)
 {
@@ -51,8 +76,12 @@ io_timer_init(io_driver_t* driver, io_timer_t* t, int tickrate)
 
   t->driver = driver;
   soft_timer_init(&t->st, tickrate);
+  t->st.run = io_timer_run;
 
   io_driver_watcher_init(&t->watcher, t->timerfd, io_timer_tick_callback);
+#if defined(IO_DRIVER_METRICS)
+  io_driver_watcher_stat_init(&t->watcher, &t->stat, "io_timer");
+#endif
   io_driver_watch(driver, &t->watcher, IO_DRIVER_EVENT_RX);
 }
 
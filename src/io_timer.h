@@ -10,6 +10,9 @@ typedef struct
   io_driver_watcher_t watcher;
   SoftTimer           st;
   int                 timerfd;
+#if defined(IO_DRIVER_METRICS)
+  io_driver_watcher_stat_t  stat;
+#endif
 } io_timer_t;
 
 extern void io_timer_init(io_driver_t* driver, io_timer_t* t, int tickrate);
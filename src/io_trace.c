@@ -0,0 +1,210 @@
+#include <string.h>
+#include <time.h>
+
+#include "io_trace.h"
+
+static const char* TAG = "io_trace";
+
+static const char*  _names[io_trace_max] =
+{
+  [io_trace_poll_enter]     = "poll",
+  [io_trace_poll_exit]      = "poll",
+  [io_trace_dispatch]       = "dispatch",
+  [io_trace_dispatch_end]   = "dispatch",
+  [io_trace_deferred]       = "deferred",
+  [io_trace_deferred_end]   = "deferred",
+  [io_trace_rx]             = "rx",
+  [io_trace_tx]             = "tx",
+  [io_trace_accept]         = "accept",
+  [io_trace_close]          = "close",
+  [io_trace_timer]          = "timer",
+  [io_trace_hs_step]        = "hs step",
+  [io_trace_hs_done]        = "hs done",
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// utilities
+//
+///////////////////////////////////////////////////////////////////////////////
+static inline uint64_t
+io_trace_now_ns(void)
+{
+  struct timespec   ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline double
+io_trace_us(const io_trace_file_hdr_t* hdr, uint64_t ts, uint64_t first)
+{
+  return (double)(int64_t)(ts - first) * hdr->ns_per_tick / 1000.0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//
+// starts recording events of driver into t.
+// @return -1 if built without IO_DRIVER_TRACE
+//
+int
+io_trace_attach(io_driver_t* driver, io_trace_t* t)
+{
+#if defined(IO_DRIVER_TRACE)
+  t->head   = 0;
+  t->ns0    = io_trace_now_ns();
+  t->tick0  = io_trace_ticks();
+
+  driver->trace = t;
+  return 0;
+#else
+  LOGE(TAG, "%s built without IO_DRIVER_TRACE\n", __func__);
+  return -1;
+#endif
+}
+
+void
+io_trace_detach(io_driver_t* driver)
+{
+#if defined(IO_DRIVER_TRACE)
+  driver->trace = NULL;
+#endif
+}
+
+//
+// writes what is in the ring, oldest first.
+// call on io_driver thread so that nothing is overwritten while writing
+//
+int
+io_trace_save(io_trace_t* t, const char* path)
+{
+  io_trace_file_hdr_t   hdr;
+  uint64_t              head = __atomic_load_n(&t->head, __ATOMIC_ACQUIRE),
+                        ticks = io_trace_ticks(),
+                        ns = io_trace_now_ns();
+  uint32_t              start,
+                        first_part;
+  FILE*                 fp;
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic       = IO_TRACE_MAGIC;
+  hdr.num         = (uint32_t)MIN(head, IO_TRACE_EVENTS);
+  hdr.ns_per_tick = ticks != t->tick0 ? (double)(ns - t->ns0) / (double)(ticks - t->tick0) : 1.0;
+  hdr.ns0         = t->ns0;
+  hdr.tick0       = t->tick0;
+
+  fp = fopen(path, "w");
+  if(fp == NULL)
+  {
+    LOGE(TAG, "%s failed to open %s\n", __func__, path);
+    return -1;
+  }
+
+  start       = (uint32_t)((head - hdr.num) & (IO_TRACE_EVENTS - 1));
+  first_part  = MIN(hdr.num, IO_TRACE_EVENTS - start);
+
+  if(fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+     fwrite(&t->ring[start], sizeof(io_trace_event_t), first_part, fp) != first_part ||
+     fwrite(&t->ring[0], sizeof(io_trace_event_t), hdr.num - first_part, fp) != hdr.num - first_part)
+  {
+    LOGE(TAG, "%s failed to write %s\n", __func__, path);
+    fclose(fp);
+    return -1;
+  }
+
+  fclose(fp);
+  return 0;
+}
+
+//
+// Chrome trace event format. poll, dispatch and deferred are slices,
+// everything else is an instant event. times in usec from the first event
+//
+int
+io_trace_write_json(FILE* fp, const io_trace_file_hdr_t* hdr, const io_trace_event_t* ev)
+{
+  const io_trace_event_t*   e;
+  uint64_t                  first;
+  int                       depth = 0;
+  double                    us;
+  const char*               sep = "";
+
+  if(hdr->magic != IO_TRACE_MAGIC)
+  {
+    LOGE(TAG, "%s bad magic %x\n", __func__, hdr->magic);
+    return -1;
+  }
+
+  first = hdr->num != 0 ? ev[0].ts : 0;
+
+  fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+  for(uint32_t i = 0; i < hdr->num; i++)
+  {
+    e   = &ev[i];
+    us  = io_trace_us(hdr, e->ts, first);
+
+    if(e->type >= io_trace_max)
+    {
+      continue;
+    }
+
+    switch(e->type)
+    {
+    case io_trace_poll_enter:
+      depth++;
+      fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":1,\"tid\":1,"
+          "\"args\":{\"maxfd\":%u}}", sep, _names[e->type], us, e->v);
+      break;
+
+    case io_trace_dispatch:
+      depth++;
+      fprintf(fp, "%s{\"name\":\"fd %u\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":1,\"tid\":1,"
+          "\"args\":{\"rx\":%d,\"tx\":%d,\"ex\":%d}}", sep, e->fd, us,
+          (e->a & IO_DRIVER_EVENT_RX) != 0, (e->a & IO_DRIVER_EVENT_TX) != 0, (e->a & IO_DRIVER_EVENT_EX) != 0);
+      break;
+
+    case io_trace_deferred:
+      depth++;
+      fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":1,\"tid\":1}",
+          sep, _names[e->type], us);
+      break;
+
+    case io_trace_poll_exit:
+    case io_trace_dispatch_end:
+    case io_trace_deferred_end:
+      if(depth == 0)
+      {
+        // its beginning was overwritten
+        continue;
+      }
+      depth--;
+      fprintf(fp, "%s{\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":1", sep, us);
+      if(e->type == io_trace_poll_exit)
+      {
+        fprintf(fp, ",\"args\":{\"ready\":%d}", (int32_t)e->v);
+      }
+      fprintf(fp, "}");
+      break;
+
+    case io_trace_hs_step:
+      fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":1,"
+          "\"args\":{\"fd\":%u,\"state\":%u,\"ret\":\"-0x%x\"}}", sep, _names[e->type], us, e->fd, e->a, e->v);
+      break;
+
+    default:
+      fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":1,"
+          "\"args\":{\"fd\":%u,\"a\":%u,\"v\":%u}}", sep, _names[e->type], us, e->fd, e->a, e->v);
+      break;
+    }
+    sep = ",\n";
+  }
+
+  fprintf(fp, "\n]}\n");
+  return 0;
+}
@@ -0,0 +1,122 @@
+//
+// binary event trace ring of an io_driver.
+//
+// built in with IO_DRIVER_TRACE (make TRACE=1) and enabled per driver with
+// io_trace_attach(). without it, IO_TRACE() compiles to nothing.
+//
+// recording is a timestamp and a 16 byte store into a fixed size ring
+// on io_driver thread. nothing is locked or allocated. the oldest events are overwritten.
+// timestamps are raw TSC ticks on x86_64 and are converted to nsec on export.
+//
+// io_trace_save() writes the ring to a file. test/trace_dump converts it to
+// Chrome trace event JSON that chrome://tracing and ui.perfetto.dev load.
+//
+#ifndef __IO_TRACE_DEF_H__
+#define __IO_TRACE_DEF_H__
+
+#include <time.h>
+#include "common_def.h"
+#include "io_driver.h"
+
+#ifndef IO_TRACE_EVENTS
+#define IO_TRACE_EVENTS             8192      // power of 2. 128KB
+#endif
+
+#define IO_TRACE_MAGIC              0x31525449    // "ITR1"
+
+typedef enum
+{
+  io_trace_poll_enter,            // v: highest fd
+  io_trace_poll_exit,             // v: select() return
+  io_trace_dispatch,              // fd, a: event mask
+  io_trace_dispatch_end,          // fd
+  io_trace_deferred,
+  io_trace_deferred_end,
+  io_trace_rx,                    // fd, v: bytes. 0 on close
+  io_trace_tx,                    // fd, v: bytes
+  io_trace_accept,                // fd: new socket
+  io_trace_close,                 // fd
+  io_trace_timer,                 // v: soft timer tick
+  io_trace_hs_step,               // fd, a: mbedtls state after step, v: -return
+  io_trace_hs_done,               // fd, a: resumed
+  io_trace_max,
+} io_trace_type_t;
+
+typedef struct
+{
+  uint64_t              ts;       // ticks
+  uint8_t               type;     // io_trace_type_t
+  uint8_t               a;
+  uint16_t              fd;       // select() fds fit
+  uint32_t              v;
+} io_trace_event_t;
+
+struct __io_trace_t
+{
+  uint64_t              head;     // total events recorded
+  uint64_t              tick0;    // clock pair for tick conversion
+  uint64_t              ns0;
+  io_trace_event_t      ring[IO_TRACE_EVENTS];
+};
+
+typedef struct __io_trace_t io_trace_t;
+
+//
+// header of a saved trace. events follow, oldest first
+//
+typedef struct
+{
+  uint32_t              magic;
+  uint32_t              num;
+  double                ns_per_tick;
+  uint64_t              ns0;
+  uint64_t              tick0;
+} io_trace_file_hdr_t;
+
+static inline uint64_t
+io_trace_ticks(void)
+{
+#if defined(__x86_64__)
+  return __builtin_ia32_rdtsc();
+#else
+  struct timespec   ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static inline void
+io_trace_emit(io_trace_t* t, io_trace_type_t type, int fd, int a, uint32_t v)
+{
+  uint64_t            head = t->head;
+  io_trace_event_t*   e = &t->ring[head & (IO_TRACE_EVENTS - 1)];
+
+  e->ts   = io_trace_ticks();
+  e->type = (uint8_t)type;
+  e->a    = (uint8_t)a;
+  e->fd   = (uint16_t)fd;
+  e->v    = v;
+
+  __atomic_store_n(&t->head, head + 1, __ATOMIC_RELEASE);
+}
+
+#if defined(IO_DRIVER_TRACE)
+#define IO_TRACE(driver, type, fd, a, v)                      \
+  do                                                          \
+  {                                                           \
+    if((driver)->trace != NULL)                               \
+    {                                                         \
+      io_trace_emit((driver)->trace, type, fd, a, v);         \
+    }                                                         \
+  } while(0)
+#else
+#define IO_TRACE(driver, type, fd, a, v)    do { UNUSED(fd); } while(0)
+#endif
+
+extern int io_trace_attach(io_driver_t* driver, io_trace_t* t);
+extern void io_trace_detach(io_driver_t* driver);
+extern int io_trace_save(io_trace_t* t, const char* path);
+extern int io_trace_write_json(FILE* fp, const io_trace_file_hdr_t* hdr, const io_trace_event_t* ev);
+
+#endif /* !__IO_TRACE_DEF_H__ */
@@ -0,0 +1,359 @@
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#if defined(__GLIBC__)
+#include <execinfo.h>
+#endif
+
+#include "io_watchdog.h"
+
+static const char* TAG = "io_watchdog";
+
+#define IO_WATCHDOG_MAX_PERIOD      (100 * 1000000ULL)    // nsec
+#define IO_WATCHDOG_BT_WAIT         100                   // msec for signal handler to answer
+#define IO_WATCHDOG_BT_SKIP         2                     // signal handler and trampoline
+
+//
+// watchdog of the io_driver thread. for signal handler
+//
+static __thread io_watchdog_t*    _self;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// utilities
+//
+///////////////////////////////////////////////////////////////////////////////
+static inline uint64_t
+io_watchdog_now_ns(void)
+{
+  struct timespec   ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+io_watchdog_print_bt(void** bt, int depth)
+{
+#if defined(__GLIBC__)
+  char**  syms = depth > 0 ? backtrace_symbols(bt, depth) : NULL;
+
+  if(syms != NULL)
+  {
+    for(int i = 0; i < depth; i++)
+    {
+      LOGE(TAG, "  %s\n", syms[i]);
+    }
+    free(syms);
+    return;
+  }
+#endif
+  for(int i = 0; i < depth; i++)
+  {
+    LOGE(TAG, "  %p\n", bt[i]);
+  }
+}
+
+static void
+io_watchdog_copy_label(char* dst, const char* label)
+{
+  memset(dst, 0, IO_DRIVER_STAT_LABEL);
+  if(label != NULL)
+  {
+    strncpy(dst, label, IO_DRIVER_STAT_LABEL - 1);
+  }
+}
+
+//
+// runs on io_driver thread, in the middle of whatever it is doing
+//
+static void
+io_watchdog_signal(int sig)
+{
+  io_watchdog_t*    wd = _self;
+
+  if(wd == NULL)
+  {
+    return;
+  }
+
+#if defined(__GLIBC__)
+  wd->bt_depth = backtrace(wd->bt, IO_WATCHDOG_BT_DEPTH + IO_WATCHDOG_BT_SKIP);
+#else
+  wd->bt_depth = 0;
+#endif
+  __atomic_store_n(&wd->bt_ack, __atomic_load_n(&wd->bt_req, __ATOMIC_RELAXED), __ATOMIC_RELEASE);
+}
+
+//
+// asks io_driver thread for a backtrace of callback seq.
+// @return TRUE if it was taken within IO_WATCHDOG_BT_WAIT
+//
+static bool
+io_watchdog_request_bt(io_watchdog_t* wd, uint64_t seq)
+{
+  uint64_t          req = wd->bt_req + 1;
+  struct timespec   ts = { 0, 1000000 };
+
+  __atomic_store_n(&wd->bt_for, seq, __ATOMIC_RELAXED);
+  __atomic_store_n(&wd->bt_req, req, __ATOMIC_RELEASE);
+
+  if(pthread_kill(wd->loop, IO_WATCHDOG_SIGNAL) != 0)
+  {
+    return FALSE;
+  }
+
+  for(int i = 0; i < IO_WATCHDOG_BT_WAIT; i++)
+  {
+    if(__atomic_load_n(&wd->bt_ack, __ATOMIC_ACQUIRE) == req)
+    {
+      return TRUE;
+    }
+    nanosleep(&ts, NULL);
+  }
+  return FALSE;
+}
+
+//
+// loop is stuck. nothing on io_driver thread is going to change under us
+//
+static void
+io_watchdog_stall(io_watchdog_t* wd, uint64_t stalled_ns)
+{
+  uint64_t    started = __atomic_load_n(&wd->started, __ATOMIC_RELAXED);
+  bool        got_bt;
+
+  wd->stalls++;
+  got_bt = io_watchdog_request_bt(wd, __atomic_load_n(&wd->seq, __ATOMIC_RELAXED));
+
+  LOGE(TAG, "io_driver made no progress for %llu sec. loop count %u\n",
+      (unsigned long long)(stalled_ns / 1000000000ULL), wd->driver->loop_count);
+
+  if(started != 0)
+  {
+    LOGE(TAG, "in callback %p %s for %llu ms\n", wd->addr, wd->label,
+        (unsigned long long)((io_watchdog_now_ns() - started) / 1000000));
+  }
+
+  if(got_bt && wd->bt_depth > IO_WATCHDOG_BT_SKIP)
+  {
+    io_watchdog_print_bt(&wd->bt[IO_WATCHDOG_BT_SKIP], wd->bt_depth - IO_WATCHDOG_BT_SKIP);
+  }
+  else
+  {
+    LOGE(TAG, "no backtrace of io_driver thread\n");
+  }
+}
+
+static void*
+io_watchdog_thread(void* arg)
+{
+  io_watchdog_t*    wd = (io_watchdog_t*)arg;
+  uint64_t          period_ns,
+                    now,
+                    started,
+                    seq,
+                    signalled = 0,
+                    progressed;
+  uint32_t          loop_count,
+                    last_count;
+  bool              dumped = FALSE;
+  struct timespec   ts;
+
+  period_ns = wd->budget_ns != 0 ? wd->budget_ns / 2 : IO_WATCHDOG_MAX_PERIOD;
+  period_ns = MIN(period_ns, IO_WATCHDOG_MAX_PERIOD);
+  period_ns = MAX(period_ns, 1000000ULL);
+
+  ts.tv_sec   = 0;
+  ts.tv_nsec  = period_ns;
+
+  last_count  = __atomic_load_n(&wd->driver->loop_count, __ATOMIC_RELAXED);
+  progressed  = io_watchdog_now_ns();
+
+  while(!__atomic_load_n(&wd->stop, __ATOMIC_RELAXED))
+  {
+    nanosleep(&ts, NULL);
+
+    seq     = __atomic_load_n(&wd->seq, __ATOMIC_RELAXED);
+    started = __atomic_load_n(&wd->started, __ATOMIC_RELAXED);
+    now     = io_watchdog_now_ns();
+
+    //
+    // one backtrace per callback, taken while it is still over budget
+    //
+    if(wd->budget_ns != 0 && started != 0 && seq != signalled && now - started > wd->budget_ns)
+    {
+      signalled = seq;
+      io_watchdog_request_bt(wd, seq);
+    }
+
+    if(wd->hard_sec == 0)
+    {
+      continue;
+    }
+
+    loop_count = __atomic_load_n(&wd->driver->loop_count, __ATOMIC_RELAXED);
+    if(loop_count != last_count)
+    {
+      last_count  = loop_count;
+      progressed  = now;
+      dumped      = FALSE;
+    }
+    else if(!dumped && now - progressed > (wd->hard_sec + IO_DRIVER_IDLE_SEC) * 1000000000ULL)
+    {
+      dumped = TRUE;
+      io_watchdog_stall(wd, now - progressed);
+    }
+  }
+  return NULL;
+}
+
+static void
+io_watchdog_record(io_watchdog_t* wd, uint64_t spent)
+{
+  io_watchdog_record_t*   r = &wd->records[wd->slow % IO_WATCHDOG_RECORDS];
+
+  r->addr         = wd->addr;
+  r->duration_ns  = spent;
+  r->bt_depth     = 0;
+  memcpy(r->label, wd->label, IO_DRIVER_STAT_LABEL);
+
+  if(__atomic_load_n(&wd->bt_ack, __ATOMIC_ACQUIRE) == __atomic_load_n(&wd->bt_req, __ATOMIC_RELAXED) &&
+     __atomic_load_n(&wd->bt_for, __ATOMIC_RELAXED) == wd->seq &&
+     wd->bt_depth > IO_WATCHDOG_BT_SKIP)
+  {
+    r->bt_depth = wd->bt_depth - IO_WATCHDOG_BT_SKIP;
+    memcpy(r->bt, &wd->bt[IO_WATCHDOG_BT_SKIP], sizeof(void*) * r->bt_depth);
+  }
+
+  wd->slow++;
+
+  LOGE(TAG, "slow callback %p %s took %llu usec\n", r->addr, r->label,
+      (unsigned long long)(spent / 1000));
+  io_watchdog_print_bt(r->bt, r->bt_depth);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// public interfaces
+//
+///////////////////////////////////////////////////////////////////////////////
+
+//
+// must be called on io_driver thread.
+// budget_ms 0 disables slow callback check, hard_sec 0 disables hard mode
+//
+int
+io_watchdog_start(io_watchdog_t* wd, io_driver_t* driver, uint32_t budget_ms, uint32_t hard_sec)
+{
+  struct sigaction  sa;
+#if defined(__GLIBC__)
+  void*             bt[1];
+#endif
+
+  memset(wd, 0, sizeof(io_watchdog_t));
+
+  wd->driver    = driver;
+  wd->budget_ns = budget_ms * 1000000ULL;
+  wd->hard_sec  = hard_sec;
+  wd->loop      = pthread_self();
+
+#if defined(__GLIBC__)
+  // first call loads libgcc. not something to do in a signal handler
+  backtrace(bt, 1);
+#endif
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = io_watchdog_signal;
+  sa.sa_flags   = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+
+  if(sigaction(IO_WATCHDOG_SIGNAL, &sa, NULL) != 0)
+  {
+    LOGE(TAG, "%s sigaction failed\n", __func__);
+    return -1;
+  }
+
+  _self = wd;
+
+  if(pthread_create(&wd->thread, NULL, io_watchdog_thread, wd) != 0)
+  {
+    LOGE(TAG, "%s pthread_create failed\n", __func__);
+    _self = NULL;
+    return -1;
+  }
+
+  driver->watchdog = wd;
+  return 0;
+}
+
+//
+// must be called on io_driver thread
+//
+void
+io_watchdog_stop(io_watchdog_t* wd)
+{
+  __atomic_store_n(&wd->stop, TRUE, __ATOMIC_RELAXED);
+  pthread_join(wd->thread, NULL);
+
+  wd->driver->watchdog = NULL;
+  _self = NULL;
+}
+
+void
+io_watchdog_dump(io_watchdog_t* wd)
+{
+  io_watchdog_record_t*   r;
+  uint64_t                num = MIN(wd->slow, IO_WATCHDOG_RECORDS);
+
+  LOGI(TAG, "slow callbacks %llu, stalls %llu\n",
+      (unsigned long long)wd->slow, (unsigned long long)wd->stalls);
+
+  // most recent first
+  for(uint64_t i = 1; i <= num; i++)
+  {
+    r = &wd->records[(wd->slow - i) % IO_WATCHDOG_RECORDS];
+    LOGI(TAG, "%p %s %llu usec\n", r->addr, r->label, (unsigned long long)(r->duration_ns / 1000));
+    io_watchdog_print_bt(r->bt, r->bt_depth);
+  }
+}
+
+//
+// called around every callback while the watchdog is running.
+// f keeps the state of the callback this one is nested in
+//
+void
+io_watchdog_enter(io_watchdog_t* wd, io_watchdog_frame_t* f, void* addr, const char* label)
+{
+  f->addr     = wd->addr;
+  f->started  = wd->started;
+  f->child_ns = wd->child_ns;
+  memcpy(f->label, wd->label, IO_DRIVER_STAT_LABEL);
+
+  wd->addr      = addr;
+  wd->child_ns  = 0;
+  io_watchdog_copy_label(wd->label, label);
+
+  __atomic_store_n(&wd->seq, wd->seq + 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&wd->started, io_watchdog_now_ns(), __ATOMIC_RELAXED);
+}
+
+void
+io_watchdog_leave(io_watchdog_t* wd, io_watchdog_frame_t* f)
+{
+  uint64_t    spent = io_watchdog_now_ns() - wd->started;
+
+  // nested callbacks answer for themselves
+  if(wd->budget_ns != 0 && spent - wd->child_ns > wd->budget_ns)
+  {
+    io_watchdog_record(wd, spent - wd->child_ns);
+  }
+
+  wd->addr      = f->addr;
+  wd->child_ns  = f->started != 0 ? f->child_ns + spent : 0;
+  memcpy(wd->label, f->label, IO_DRIVER_STAT_LABEL);
+
+  __atomic_store_n(&wd->seq, wd->seq + 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&wd->started, f->started, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,89 @@
+//
+// slow callback watchdog for an io_driver thread.
+//
+// every watcher, deferred and soft timer callback is timed against a budget.
+// a helper thread notices a callback running over budget and interrupts the
+// io_driver thread with IO_WATCHDOG_SIGNAL to take a backtrace of it where it is.
+// once the callback returns, the record is logged and kept. the loop is never stopped.
+//
+// in hard mode the helper thread also dumps state, with backtrace of the
+// io_driver thread, when the loop has made no progress for hard_sec seconds
+// on top of IO_DRIVER_IDLE_SEC, an idle select() being no stall.
+//
+// the signal is installed with SA_RESTART. a callback sleeping in nanosleep()
+// when it arrives wakes up early.
+//
+#ifndef __IO_WATCHDOG_DEF_H__
+#define __IO_WATCHDOG_DEF_H__
+
+#include <pthread.h>
+#include <signal.h>
+#include "io_driver.h"
+
+#ifndef IO_WATCHDOG_SIGNAL
+#define IO_WATCHDOG_SIGNAL          (SIGRTMIN + 3)
+#endif
+
+#define IO_WATCHDOG_BT_DEPTH        16
+#define IO_WATCHDOG_RECORDS         8       // most recent slow callbacks kept
+
+typedef struct
+{
+  void*                 addr;             // callback function
+  char                  label[IO_DRIVER_STAT_LABEL];
+  uint64_t              duration_ns;      // excluding nested callbacks
+  int                   bt_depth;         // 0 if no backtrace was taken in time
+  void*                 bt[IO_WATCHDOG_BT_DEPTH];
+} io_watchdog_record_t;
+
+//
+// state of the callback interrupted by a nested one.
+// soft timer callbacks run inside io_timer watcher callback
+//
+typedef struct
+{
+  void*                 addr;
+  char                  label[IO_DRIVER_STAT_LABEL];
+  uint64_t              started;
+  uint64_t              child_ns;
+} io_watchdog_frame_t;
+
+struct __io_watchdog_t
+{
+  io_driver_t*          driver;
+  uint64_t              budget_ns;
+  uint32_t              hard_sec;         // 0 disables hard mode
+  pthread_t             loop;             // io_driver thread
+  pthread_t             thread;
+  bool                  stop;
+
+  // callback running now. written by io_driver thread only
+  void*                 addr;
+  char                  label[IO_DRIVER_STAT_LABEL];
+  uint64_t              started;          // 0 if none
+  uint64_t              child_ns;
+  uint64_t              seq;              // bumped on every enter/leave
+
+  // backtrace taken by signal handler on io_driver thread
+  uint64_t              bt_req;           // bumped by watchdog thread to ask
+  uint64_t              bt_ack;           // set to bt_req once taken
+  uint64_t              bt_for;           // seq of callback asked for
+  int                   bt_depth;
+  void*                 bt[IO_WATCHDOG_BT_DEPTH + 2];
+
+  // statistics
+  uint64_t              slow;
+  uint64_t              stalls;
+  io_watchdog_record_t  records[IO_WATCHDOG_RECORDS];
+};
+
+typedef struct __io_watchdog_t io_watchdog_t;
+
+extern int io_watchdog_start(io_watchdog_t* wd, io_driver_t* driver, uint32_t budget_ms, uint32_t hard_sec);
+extern void io_watchdog_stop(io_watchdog_t* wd);
+extern void io_watchdog_dump(io_watchdog_t* wd);
+
+extern void io_watchdog_enter(io_watchdog_t* wd, io_watchdog_frame_t* f, void* addr, const char* label);
+extern void io_watchdog_leave(io_watchdog_t* wd, io_watchdog_frame_t* f);
+
+#endif /* !__IO_WATCHDOG_DEF_H__ */
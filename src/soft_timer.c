@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "soft_timer.h"
+#include "io_probe.h"
 
 /**
  * initialize a timer manager
@@ -22,6 +23,9 @@ soft_timer_init(SoftTimer* timer, int tick_rate)
 
   timer->tick_rate           = tick_rate;
   timer->tick                =      0;
+  timer->run                 =   NULL;
+  timer->active              =      0;
+  timer->expired             =      0;
 
   for(i = 0; i < SOFT_TIMER_NUM_BUCKETS; i++)
   {
@@ -75,6 +79,7 @@ soft_timer_add(SoftTimer* timer, SoftTimerElem* elem, int expires)
   target         = elem->tick % SOFT_TIMER_NUM_BUCKETS;
 
   list_add_tail(&elem->next, &timer->buckets[target]);
+  timer->active++;
 }
 
 /**
@@ -91,6 +96,7 @@ soft_timer_del(SoftTimer* timer, SoftTimerElem* elem)
     return;
   }
   list_del_init(&elem->next);
+  timer->active--;
 }
 
 static void
@@ -101,6 +107,7 @@ timer_tick(SoftTimer* timer)
   struct list_head  timeout_list = LIST_HEAD_INIT(timeout_list);
 
   timer->tick++;
+  IO_PROBE1(soft_timer, tick, timer->tick);
 
   current = timer->tick % SOFT_TIMER_NUM_BUCKETS;
 
@@ -124,7 +131,17 @@ timer_tick(SoftTimer* timer)
   {
     p = list_first_entry(&timeout_list, SoftTimerElem, next);
     list_del_init(&p->next);
-    p->cb(p);
+    timer->active--;
+    timer->expired++;
+    IO_PROBE2(soft_timer, expire, p->cb, p);
+    if(timer->run != NULL)
+    {
+      timer->run(timer, p);
+    }
+    else
+    {
+      p->cb(p);
+    }
   }
 }
 
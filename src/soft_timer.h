@@ -17,6 +17,13 @@ typedef struct _soft_timer_elem SoftTimerElem;
  */
 typedef void (*timer_cb)(SoftTimerElem*);
 
+struct _timer;
+
+/**
+ * runs timeout callback of an expired element. for wrapping callbacks
+ */
+typedef void (*timer_run_cb)(struct _timer*, SoftTimerElem*);
+
 /**
  * timer element representing one timer
  */
@@ -36,6 +43,9 @@ typedef struct _timer
   int                  tick_rate;                                  /** tick rate 1 means a tick per 1ms      */
   unsigned int         tick;                                       /** current tick                          */
   struct list_head     buckets[SOFT_TIMER_NUM_BUCKETS];            /** bucket array                          */
+  timer_run_cb         run;                                        /** NULL calls timeout callback directly  */
+  unsigned int         active;                                     /** elements running now                  */
+  unsigned long        expired;                                    /** timeout callbacks run so far          */
 } SoftTimer;
 
 extern int soft_timer_init(SoftTimer* timer, int tick_rate);
@@ -6,6 +6,7 @@
 #include <sys/time.h>
 
 #include "cli.h"
+#include "io_trace.h"
 
 extern void cli_telnet_intf_init(int port);
 
@@ -28,6 +29,9 @@ static int cli_command_help(cli_intf_t* intf, int argc, const char** argv);
 static int cli_command_version(cli_intf_t* intf, int argc, const char** argv);
 static int cli_command_cli_connections(cli_intf_t* intf, int argc, const char** argv);
 static int cli_command_exit(cli_intf_t* intf, int argc, const char** argv);
+static int cli_command_loop(cli_intf_t* intf, int argc, const char** argv);
+static int cli_command_top(cli_intf_t* intf, int argc, const char** argv);
+static int cli_command_trace(cli_intf_t* intf, int argc, const char** argv);
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -53,6 +57,21 @@ static cli_command_t    _core_commands[] =
     "show current CLI connections",
     cli_command_cli_connections,
   },
+  {
+    "loop",
+    "show event loop metrics",
+    cli_command_loop,
+  },
+  {
+    "top",
+    "show most expensive watchers. top [count] [perf|noperf]",
+    cli_command_top,
+  },
+  {
+    "trace",
+    "event trace. trace start|stop|save <file>",
+    cli_command_trace,
+  },
   {
     "exit",
     "exit cli",
@@ -108,6 +127,124 @@ cli_command_cli_connections(cli_intf_t* intf, int argc, const char** argv)
   return 0;
 }
 
+static int
+cli_command_loop(cli_intf_t* intf, int argc, const char** argv)
+{
+  static io_driver_metrics_t  m;
+  uint64_t                    iterations;
+
+  cli_printf(intf, CLI_EOL);
+
+  if(io_driver_metrics_snapshot(cli_io_driver(), &m) != 0)
+  {
+    cli_printf(intf, "metrics not built in"CLI_EOL);
+    return 0;
+  }
+
+  iterations = m.iterations != 0 ? m.iterations : 1;
+
+  cli_printf(intf, "iterations     : %llu"CLI_EOL, (unsigned long long)m.iterations);
+  cli_printf(intf, "watchers       : %llu"CLI_EOL, (unsigned long long)m.watchers);
+  cli_printf(intf, "events         : %llu"CLI_EOL, (unsigned long long)m.events);
+  cli_printf(intf, "deferred       : %llu"CLI_EOL, (unsigned long long)m.deferred);
+  cli_printf(intf, "poll/busy      : %llu/%llu ms"CLI_EOL,
+      (unsigned long long)(m.poll_ns / 1000000), (unsigned long long)(m.busy_ns / 1000000));
+  cli_printf(intf, "events/loop    : mean %.2f, max %llu"CLI_EOL,
+      (double)m.events / iterations, (unsigned long long)m.max_events);
+  cli_printf(intf, "loop lag usec  : p50 %llu, p99 %llu, p999 %llu, max %llu"CLI_EOL,
+      (unsigned long long)(io_hist_percentile(&m.loop_lag, 50) / 1000),
+      (unsigned long long)(io_hist_percentile(&m.loop_lag, 99) / 1000),
+      (unsigned long long)(io_hist_percentile(&m.loop_lag, 99.9) / 1000),
+      (unsigned long long)(m.loop_lag.max / 1000));
+  cli_printf(intf, "callback usec  : p50 %llu, p99 %llu, p999 %llu, max %llu"CLI_EOL,
+      (unsigned long long)(io_hist_percentile(&m.callback, 50) / 1000),
+      (unsigned long long)(io_hist_percentile(&m.callback, 99) / 1000),
+      (unsigned long long)(io_hist_percentile(&m.callback, 99.9) / 1000),
+      (unsigned long long)(m.callback.max / 1000));
+
+  return 0;
+}
+
+static int
+cli_command_top(cli_intf_t* intf, int argc, const char** argv)
+{
+  static io_driver_watcher_stat_t   top[16];
+  int                               n = 10;
+
+  cli_printf(intf, CLI_EOL);
+
+  if(argc >= 2)
+  {
+    n = MIN(atoi(argv[1]), 16);
+  }
+
+  if(argc >= 3 && strcmp(argv[2], "perf") == 0 && io_driver_perf_enable(cli_io_driver()) != 0)
+  {
+    cli_printf(intf, "perf counters not available"CLI_EOL);
+  }
+  else if(argc >= 3 && strcmp(argv[2], "noperf") == 0)
+  {
+    io_driver_perf_disable(cli_io_driver());
+  }
+
+  n = io_driver_watcher_top(cli_io_driver(), top, n);
+  if(n < 0)
+  {
+    cli_printf(intf, "metrics not built in"CLI_EOL);
+    return 0;
+  }
+
+  cli_printf(intf, "%-32s %10s %10s %10s %12s %10s"CLI_EOL,
+      "label", "count", "total ms", "max usec", "cycles", "misses");
+  for(int i = 0; i < n; i++)
+  {
+    cli_printf(intf, "%-32s %10llu %10llu %10llu %12llu %10llu"CLI_EOL,
+        top[i].label,
+        (unsigned long long)top[i].count,
+        (unsigned long long)(top[i].time_ns / 1000000),
+        (unsigned long long)(top[i].max_ns / 1000),
+        (unsigned long long)top[i].cycles,
+        (unsigned long long)top[i].cache_misses);
+  }
+
+  return 0;
+}
+
+static int
+cli_command_trace(cli_intf_t* intf, int argc, const char** argv)
+{
+  static io_trace_t   trace;
+
+  cli_printf(intf, CLI_EOL);
+
+  if(argc >= 2 && strcmp(argv[1], "start") == 0)
+  {
+    if(io_trace_attach(cli_io_driver(), &trace) != 0)
+    {
+      cli_printf(intf, "trace not built in"CLI_EOL);
+    }
+  }
+  else if(argc >= 2 && strcmp(argv[1], "stop") == 0)
+  {
+    io_trace_detach(cli_io_driver());
+  }
+  else if(argc >= 3 && strcmp(argv[1], "save") == 0)
+  {
+    if(io_trace_save(&trace, argv[2]) != 0)
+    {
+      cli_printf(intf, "failed to save %s"CLI_EOL, argv[2]);
+      return 0;
+    }
+    cli_printf(intf, "saved. convert with trace_dump %s"CLI_EOL, argv[2]);
+  }
+  else
+  {
+    cli_printf(intf, "trace start|stop|save <file>"CLI_EOL);
+  }
+
+  return 0;
+}
+
 static int
 cli_command_exit(cli_intf_t* intf, int argc, const char** argv)
 {
@@ -4,6 +4,7 @@
 #include "io_driver.h"
 #include "io_net.h"
 #include "io_telnet.h"
+#include "io_http_metrics.h"
 
 #include "generic_list.h"
 #include "telnet.h"
@@ -28,6 +29,7 @@ static const char* TAG = "main";
 static io_driver_t        io_driver;
 static struct list_head   conns;
 static io_telnet_t        tserver;
+static io_http_metrics_t  metrics;
 
 
 io_driver_t*
@@ -55,7 +57,7 @@ cli_tx_resume(cli_conn_t* c)
             ret,
             len;
 
-  LOGI(TAG, "cli_tx_resume\n");
+  LOGD(TAG, "cli_tx_resume\n");
 
   while(1)
   {
@@ -136,7 +138,12 @@ alloc_cli_connection(void)
 {
   cli_conn_t*   c;
 
-  c = malloc(sizeof(cli_conn_t));
+  c = io_driver_alloc(&io_driver, io_alloc_app, sizeof(cli_conn_t));
+  if(c == NULL)
+  {
+    return NULL;
+  }
+  memset(c, 0, sizeof(cli_conn_t));
   INIT_LIST_HEAD(&c->le);
 
   list_add_tail(&c->le, &conns);
@@ -146,7 +153,7 @@ alloc_cli_connection(void)
 
   cli_intf_register(&c->cli_if);
 
-  circ_buffer_init(&c->txcb, 512);
+  circ_buffer_init_with_allocator(&c->txcb, 512, io_driver.allocator);
 
   LOGI(TAG, "new connection :\n");
   return c;
@@ -160,7 +167,7 @@ dealloc_cli_connection(cli_conn_t* c)
   list_del(&c->le);
   circ_buffer_deinit(&c->txcb);
   cli_intf_unregister(&c->cli_if);
-  free(c);
+  io_driver_free(&io_driver, io_alloc_app, c, sizeof(cli_conn_t));
 }
 
 static io_net_return_t
@@ -182,9 +189,16 @@ telnet_server_callback(io_telnet_t* t, io_telnet_event_t* e)
 
   case io_net_event_enum_connected:
     c = container_of(t, cli_conn_t, tconn); 
+    // output queue counts against memory limits of the connection
+    io_net_mem_charge(&t->n, c->txcb.size);
     init_telnet_session(c);
     return io_net_return_continue;
 
+  case io_net_event_enum_paused:
+  case io_net_event_enum_resumed:
+    LOGI(TAG, "reads %s by memory limit\n", e->ev == io_net_event_enum_paused ? "paused" : "resumed");
+    return io_net_return_continue;
+
   case io_net_event_enum_rx:
     c = container_of(t, cli_conn_t, tconn); 
     if(e->r.buf[0] != 0)
@@ -205,6 +219,7 @@ telnet_server_callback(io_telnet_t* t, io_telnet_event_t* e)
   case io_net_event_enum_closed:
     c = container_of(t, cli_conn_t, tconn); 
     LOGI(TAG, "Close event :\n");
+    io_net_rx_pool_dump(&io_driver);
     dealloc_cli_connection(c);
     return io_net_return_stop;
 
@@ -223,7 +238,9 @@ main()
   INIT_LIST_HEAD(&conns);
 
   io_driver_init(&io_driver);
+  io_log_start();
   io_telnet_bind(&io_driver, &tserver, 11060, telnet_server_callback);
+  io_http_metrics_start(&io_driver, &metrics, 11080);
   cli_init(NULL, 0, 0);
 
   while(1)
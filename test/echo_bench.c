@@ -0,0 +1,537 @@
+//
+// loopback echo throughput and round trip latency over io_net.
+//
+// echo server runs in a forked process on its own io_driver. client keeps
+// one message in flight per connection and measures every round trip.
+// for each mode, message size and connection count, connections are set up
+// first, one by one, then messages are exchanged for the given time.
+//
+// bytes/s counts payload echoed back, one direction.
+// latency percentiles are bucket upper bounds of io_hist, within 25%.
+//
+// echo_bench [tcp|tls|all] [seconds per case] [json output]
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "io_driver.h"
+#include "io_net.h"
+#include "circ_buffer.h"
+
+#define BENCH_PORT          11073     // TLS on BENCH_PORT + 1
+#define BENCH_MAX_SIZE      16384
+#define BENCH_MAX_CONNS     64
+
+typedef struct
+{
+  io_net_t            n;
+  io_ssl_t            s;
+  circ_buffer_t       q;              // echo not taken by socket yet
+  uint8_t             qmem[BENCH_MAX_SIZE * 2];
+  uint8_t             rx_buf[BENCH_MAX_SIZE];
+  uint8_t             tx_buf[BENCH_MAX_SIZE * 2];
+} echo_conn_t;
+
+typedef struct
+{
+  io_net_t            n;
+  io_ssl_t            s;
+  uint8_t             rx_buf[BENCH_MAX_SIZE];
+  uint8_t             tx_buf[BENCH_MAX_SIZE * 2];
+  int                 tx_off;         // of message being sent
+  int                 rx_got;         // of message being echoed
+  uint64_t            sent_ns;
+  bool                busy;           // message in flight
+} bench_conn_t;
+
+typedef struct
+{
+  bool                tls;
+  int                 size;
+  int                 conns;
+} bench_case_t;
+
+static const char* TAG = "main";
+
+static const int          sizes[] = { 64, 1024, 16384 };
+static const int          conn_counts[] = { 1, 16, 64 };
+
+static io_driver_t        io_driver;
+static io_ssl_ctx_t       ctx;            // server context in server process, client one here
+static bool               with_tls;
+
+//
+// client side
+//
+static bench_conn_t       conns[BENCH_MAX_CONNS];
+static uint8_t            msg[BENCH_MAX_SIZE];
+
+static bench_case_t       cases[2 * 3 * 3];
+static int                num_cases;
+static int                current;
+
+static int                duration;
+static FILE*              out;
+static pid_t              server;
+
+static int                ready;
+static int                busy;
+static bool               running;
+static uint64_t           started;
+static uint64_t           completed;
+static io_hist_t          rtt;
+static io_driver_deferred_t next_case;
+
+static io_net_return_t client_callback(io_net_t* n, io_net_event_t* e);
+
+static uint64_t
+now_ns(void)
+{
+  struct timespec   ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// echo server
+//
+///////////////////////////////////////////////////////////////////////////////
+static void
+echo_resume(echo_conn_t* c)
+{
+  uint8_t   buffer[BENCH_MAX_SIZE];
+  int       len,
+            ret;
+
+  while(!circ_buffer_is_empty(&c->q))
+  {
+    len = MIN(circ_buffer_get_data_size(&c->q), BENCH_MAX_SIZE);
+    circ_buffer_peek(&c->q, buffer, len);
+
+    ret = io_net_tx(&c->n, buffer, len);
+    if(ret <= 0)
+    {
+      return;
+    }
+    circ_buffer_advance(&c->q, ret);
+  }
+}
+
+static void
+echo_tx(echo_conn_t* c, uint8_t* buf, int len)
+{
+  int   ret;
+
+  if(!circ_buffer_is_empty(&c->q))
+  {
+    circ_buffer_put(&c->q, buf, len);
+    return;
+  }
+
+  while(len > 0)
+  {
+    ret = io_net_tx(&c->n, buf, len);
+    if(ret < 0)
+    {
+      return;
+    }
+    else if(ret == 0)
+    {
+      // resumed on TX event
+      circ_buffer_put(&c->q, buf, len);
+      return;
+    }
+    buf += ret;
+    len -= ret;
+  }
+}
+
+static io_net_return_t
+server_callback(io_net_t* n, io_net_event_t* e)
+{
+  echo_conn_t*  c;
+
+  switch(e->ev)
+  {
+  case io_net_event_enum_alloc_connection:
+    c = calloc(1, sizeof(echo_conn_t));
+    if(c == NULL)
+    {
+      return io_net_return_stop;
+    }
+    circ_buffer_init_with_mem(&c->q, c->qmem, sizeof(c->qmem));
+    e->c.n = &c->n;
+    e->c.s = &c->s;
+    return io_net_return_continue;
+
+  case io_net_event_enum_connected:
+    c = container_of(n, echo_conn_t, n);
+    io_net_set_rx_buf(n, c->rx_buf, sizeof(c->rx_buf));
+    if(n->ssl != NULL)
+    {
+      io_ssl_set_tx_buf(&c->s, c->tx_buf, sizeof(c->tx_buf));
+    }
+    return io_net_return_continue;
+
+  case io_net_event_enum_rx:
+    c = container_of(n, echo_conn_t, n);
+    echo_tx(c, e->r.buf, e->r.len);
+    return io_net_return_continue;
+
+  case io_net_event_enum_tx:
+    c = container_of(n, echo_conn_t, n);
+    echo_resume(c);
+    return io_net_return_continue;
+
+  case io_net_event_enum_closed:
+    c = container_of(n, echo_conn_t, n);
+    io_net_close(n);
+    free(c);
+    return io_net_return_stop;
+
+  default:
+    break;
+  }
+  return io_net_return_continue;
+}
+
+static void
+server_main(int ready_fd)
+{
+  static io_net_t   ntcp,
+                    ntls;
+
+  io_driver_init(&io_driver);
+
+  if(io_net_bind(&io_driver, &ntcp, NULL, BENCH_PORT, server_callback) != 0 ||
+     (with_tls && (io_ssl_ctx_init_server(&ctx) != 0 ||
+                   io_net_bind(&io_driver, &ntls, &ctx, BENCH_PORT + 1, server_callback) != 0)))
+  {
+    LOGE(TAG, "failed to start echo server\n");
+    exit(-1);
+  }
+
+  if(write(ready_fd, "r", 1) != 1)
+  {
+    exit(-1);
+  }
+  close(ready_fd);
+
+  while(1)
+  {
+    io_driver_run(&io_driver);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// client
+//
+///////////////////////////////////////////////////////////////////////////////
+static void
+client_pump(bench_conn_t* c)
+{
+  int   size = cases[current].size,
+        ret;
+
+  while(c->tx_off < size)
+  {
+    ret = io_net_tx(&c->n, &msg[c->tx_off], size - c->tx_off);
+    if(ret < 0)
+    {
+      LOGE(TAG, "client tx error\n");
+      exit(-1);
+    }
+    else if(ret == 0)
+    {
+      // resumed on TX event
+      return;
+    }
+    c->tx_off += ret;
+  }
+}
+
+static void
+client_send(bench_conn_t* c)
+{
+  c->tx_off   = 0;
+  c->rx_got   = 0;
+  c->busy     = TRUE;
+  c->sent_ns  = now_ns();
+  busy++;
+
+  client_pump(c);
+}
+
+static void
+client_connect(int ndx)
+{
+  bench_conn_t*   c = &conns[ndx];
+  bench_case_t*   bc = &cases[current];
+
+  if(io_net_connect(&io_driver, &c->n, bc->tls ? &ctx : NULL, bc->tls ? &c->s : NULL,
+        "127.0.0.1", bc->tls ? BENCH_PORT + 1 : BENCH_PORT, client_callback) != 0)
+  {
+    LOGE(TAG, "failed to connect\n");
+    exit(-1);
+  }
+}
+
+static void
+case_start(void* arg)
+{
+  bench_case_t*   bc;
+
+  if(current == num_cases)
+  {
+    fprintf(out, "\n]}\n");
+    fclose(out);
+
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    exit(0);
+  }
+
+  bc = &cases[current];
+  LOGI(TAG, "%s, %d bytes, %d connections\n", bc->tls ? "tls" : "tcp", bc->size, bc->conns);
+
+  ready     = 0;
+  busy      = 0;
+  running   = FALSE;
+  completed = 0;
+  io_hist_init(&rtt);
+
+  // one by one. listen backlog is small
+  client_connect(0);
+}
+
+static void
+case_finish(void)
+{
+  bench_case_t*   bc = &cases[current];
+  double          sec = (now_ns() - started) / 1e9;
+
+  LOGI(TAG, "  %.0f msgs/s, %.1f MB/s, rtt p50 %llu us, p99 %llu us, p999 %llu us\n",
+      completed / sec, completed * bc->size / sec / (1024 * 1024),
+      (unsigned long long)(io_hist_percentile(&rtt, 50) / 1000),
+      (unsigned long long)(io_hist_percentile(&rtt, 99) / 1000),
+      (unsigned long long)(io_hist_percentile(&rtt, 99.9) / 1000));
+
+  fprintf(out, "%s  {\"mode\":\"%s\",\"size\":%d,\"conns\":%d,\"msgs\":%llu,\"sec\":%.3f,"
+      "\"msgs_per_sec\":%.1f,\"bytes_per_sec\":%.1f,"
+      "\"rtt_us\":{\"mean\":%.1f,\"p50\":%.1f,\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}}",
+      current == 0 ? "" : ",\n", bc->tls ? "tls" : "tcp", bc->size, bc->conns,
+      (unsigned long long)completed, sec, completed / sec, completed * bc->size / sec,
+      io_hist_mean(&rtt) / 1e3,
+      io_hist_percentile(&rtt, 50) / 1e3,
+      io_hist_percentile(&rtt, 99) / 1e3,
+      io_hist_percentile(&rtt, 99.9) / 1e3,
+      rtt.max / 1e3);
+  fflush(out);
+
+  for(int i = 0; i < bc->conns; i++)
+  {
+    io_net_close(&conns[i].n);
+  }
+
+  current++;
+  io_driver_defer(&io_driver, &next_case);
+}
+
+static void
+client_ready(bench_conn_t* c)
+{
+  bench_case_t*   bc = &cases[current];
+
+  ready++;
+  if(ready < bc->conns)
+  {
+    client_connect(ready);
+    return;
+  }
+
+  running = TRUE;
+  started = now_ns();
+
+  for(int i = 0; i < bc->conns; i++)
+  {
+    client_send(&conns[i]);
+  }
+}
+
+//
+// @return TRUE if connections are closed for the next case
+//
+static bool
+client_rx(bench_conn_t* c, int len)
+{
+  uint64_t    now;
+
+  c->rx_got += len;
+  if(c->rx_got < cases[current].size)
+  {
+    return FALSE;
+  }
+
+  now = now_ns();
+  io_hist_record(&rtt, now - c->sent_ns);
+  completed++;
+
+  c->busy = FALSE;
+  busy--;
+
+  if(running && now - started >= duration * 1000000000ULL)
+  {
+    running = FALSE;
+  }
+
+  if(running)
+  {
+    client_send(c);
+  }
+  else if(busy == 0)
+  {
+    case_finish();
+    return TRUE;
+  }
+  return FALSE;
+}
+
+static io_net_return_t
+client_callback(io_net_t* n, io_net_event_t* e)
+{
+  bench_conn_t*   c = container_of(n, bench_conn_t, n);
+
+  switch(e->ev)
+  {
+  case io_net_event_enum_connected:
+    io_net_set_rx_buf(n, c->rx_buf, sizeof(c->rx_buf));
+    if(n->ssl != NULL)
+    {
+      io_ssl_set_tx_buf(&c->s, c->tx_buf, sizeof(c->tx_buf));
+      break;
+    }
+    client_ready(c);
+    break;
+
+  case io_net_event_enum_handshaken:
+    client_ready(c);
+    break;
+
+  case io_net_event_enum_rx:
+    if(client_rx(c, e->r.len))
+    {
+      return io_net_return_stop;
+    }
+    break;
+
+  case io_net_event_enum_tx:
+    if(c->busy)
+    {
+      client_pump(c);
+    }
+    break;
+
+  case io_net_event_enum_closed:
+    LOGE(TAG, "connection closed by server\n");
+    kill(server, SIGTERM);
+    exit(-1);
+
+  default:
+    break;
+  }
+  return io_net_return_continue;
+}
+
+int
+main(int argc, char** argv)
+{
+  const char*   mode = argc > 1 ? argv[1] : "all";
+  const char*   path = argc > 3 ? argv[3] : "bench.json";
+  int           fds[2];
+  char          r;
+
+  duration = argc > 2 ? atoi(argv[2]) : 2;
+
+  for(int t = 0; t < 2; t++)
+  {
+    if((t == 0 && strcmp(mode, "tls") == 0) || (t == 1 && strcmp(mode, "tcp") == 0))
+    {
+      continue;
+    }
+
+    for(int s = 0; s < NARRAY(sizes); s++)
+    {
+      for(int k = 0; k < NARRAY(conn_counts); k++)
+      {
+        with_tls               |= t == 1;
+        cases[num_cases].tls    = t == 1;
+        cases[num_cases].size   = sizes[s];
+        cases[num_cases].conns  = conn_counts[k];
+        num_cases++;
+      }
+    }
+  }
+
+  memset(msg, 'e', sizeof(msg));
+
+  if(pipe(fds) != 0)
+  {
+    return -1;
+  }
+
+  server = fork();
+  if(server < 0)
+  {
+    LOGE(TAG, "fork failed\n");
+    return -1;
+  }
+  else if(server == 0)
+  {
+    close(fds[0]);
+    server_main(fds[1]);
+  }
+
+  close(fds[1]);
+  if(read(fds[0], &r, 1) != 1)
+  {
+    LOGE(TAG, "echo server didn't start\n");
+    return -1;
+  }
+  close(fds[0]);
+
+  out = fopen(path, "w");
+  if(out == NULL)
+  {
+    LOGE(TAG, "failed to open %s\n", path);
+    kill(server, SIGTERM);
+    return -1;
+  }
+  fprintf(out, "{\"bench\":\"echo\",\"seconds_per_case\":%d,\"results\":[\n", duration);
+
+  io_driver_init(&io_driver);
+
+  if(with_tls && io_ssl_ctx_init_client(&ctx) != 0)
+  {
+    LOGE(TAG, "failed to init ssl context\n");
+    kill(server, SIGTERM);
+    return -1;
+  }
+
+  io_driver_deferred_init(&next_case, case_start, NULL);
+  case_start(NULL);
+
+  while(1)
+  {
+    io_driver_run(&io_driver);
+  }
+
+  return 0;
+}
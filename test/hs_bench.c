@@ -0,0 +1,194 @@
+//
+// full TLS handshakes per second with ECDSA or RSA server certificate.
+// client and server run on the same io_driver. the client offers only
+// cipher suites of the given signature type so that the server has to pick
+// the matching certificate/key pair.
+//
+// hs_bench [ecdsa|rsa] [count]
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "io_driver.h"
+#include "io_net.h"
+
+#define BENCH_PORT          11072
+
+typedef struct
+{
+  io_net_t            n;
+  io_ssl_t            sconn;
+  uint8_t             rx_buf[128];
+} hs_conn_t;
+
+static const char* TAG = "main";
+static io_driver_t        io_driver;
+
+static io_ssl_ctx_t       sctx;
+static io_ssl_ctx_t       cctx;
+
+static io_net_t           nserver;
+
+static io_net_t           nclient;
+static io_ssl_t           sclient;
+static uint8_t            crx_buf[128];
+
+static const int          ecdsa_suites[] =
+{
+  MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
+  0,
+};
+
+static const int          rsa_suites[] =
+{
+  MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256,
+  0,
+};
+
+static int                total;
+static int                done;
+static const char*        suite;
+static struct timespec    started;
+
+static io_net_return_t client_callback(io_net_t* n, io_net_event_t* e);
+
+static double
+elapsed_sec(void)
+{
+  struct timespec   now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - started.tv_sec) + (now.tv_nsec - started.tv_nsec) / 1e9;
+}
+
+static void
+start_connect(void)
+{
+  //
+  // forget the session so that every handshake is a full one
+  //
+  for(int i = 0; i < IO_SSL_CLIENT_SESSIONS; i++)
+  {
+    cctx.sessions[i].valid = FALSE;
+  }
+
+  if(io_net_connect(&io_driver, &nclient, &cctx, &sclient, "127.0.0.1", BENCH_PORT, client_callback) != 0)
+  {
+    LOGE(TAG, "failed to connect\n");
+    exit(-1);
+  }
+}
+
+static io_net_return_t
+server_callback(io_net_t* n, io_net_event_t* e)
+{
+  hs_conn_t*  c;
+
+  switch(e->ev)
+  {
+  case io_net_event_enum_alloc_connection:
+    c = calloc(1, sizeof(hs_conn_t));
+    if(c == NULL)
+    {
+      return io_net_return_stop;
+    }
+    e->c.n = &c->n;
+    e->c.s = &c->sconn;
+    return io_net_return_continue;
+
+  case io_net_event_enum_connected:
+    c = container_of(n, hs_conn_t, n);
+    io_net_set_rx_buf(n, c->rx_buf, sizeof(c->rx_buf));
+    return io_net_return_continue;
+
+  case io_net_event_enum_closed:
+    c = container_of(n, hs_conn_t, n);
+    io_net_close(n);
+    free(c);
+    return io_net_return_stop;
+
+  default:
+    break;
+  }
+  return io_net_return_continue;
+}
+
+static io_net_return_t
+client_callback(io_net_t* n, io_net_event_t* e)
+{
+  double    sec;
+
+  switch(e->ev)
+  {
+  case io_net_event_enum_connected:
+    io_net_set_rx_buf(n, crx_buf, sizeof(crx_buf));
+    break;
+
+  case io_net_event_enum_handshaken:
+    suite = mbedtls_ssl_get_ciphersuite(&sclient.ssl);
+    io_net_close(n);
+    done++;
+
+    if(done == total)
+    {
+      sec = elapsed_sec();
+      LOGI(TAG, "%d handshakes with %s in %.3f sec. %.1f handshakes/s\n",
+          done, suite, sec, done / sec);
+
+      for(int i = 0; i < sctx.num_certs; i++)
+      {
+        LOGI(TAG, "server cert %d %s: %u handshakes\n", i,
+            mbedtls_pk_get_name(&sctx.certs[i].pkey), sctx.certs[i].handshakes);
+      }
+      exit(0);
+    }
+
+    start_connect();
+    return io_net_return_stop;
+
+  case io_net_event_enum_closed:
+    LOGE(TAG, "handshake failed\n");
+    exit(-1);
+
+  default:
+    break;
+  }
+  return io_net_return_continue;
+}
+
+int
+main(int argc, char** argv)
+{
+  const char*   type = argc > 1 ? argv[1] : "ecdsa";
+
+  total = argc > 2 ? atoi(argv[2]) : 200;
+
+  io_driver_init(&io_driver);
+
+  if(io_ssl_ctx_init_server(&sctx) != 0 || io_ssl_ctx_init_client(&cctx) != 0)
+  {
+    LOGE(TAG, "failed to init ssl context\n");
+    return -1;
+  }
+
+  io_ssl_ctx_set_ciphersuites(&cctx, strcmp(type, "rsa") == 0 ? rsa_suites : ecdsa_suites);
+
+  if(io_net_bind(&io_driver, &nserver, &sctx, BENCH_PORT, server_callback) != 0)
+  {
+    LOGE(TAG, "failed to bind\n");
+    return -1;
+  }
+
+  LOGI(TAG, "running %d %s handshakes\n", total, type);
+
+  clock_gettime(CLOCK_MONOTONIC, &started);
+  start_connect();
+
+  while(1)
+  {
+    io_driver_run(&io_driver);
+  }
+
+  return 0;
+}
@@ -0,0 +1,179 @@
+//
+// loopback TLS throughput with and without kernel TLS.
+// client and server run on the same io_driver.
+//
+// ktls_bench [ktls 0/1] [MBytes]
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "io_driver.h"
+#include "io_net.h"
+
+#define BENCH_PORT          11071
+#define BENCH_CHUNK         16384
+
+static const char* TAG = "main";
+static io_driver_t        io_driver;
+
+static io_ssl_ctx_t       sctx;
+static io_ssl_ctx_t       cctx;
+
+static io_net_t           nserver;
+static io_net_t           nconn;
+static io_ssl_t           sconn;
+static uint8_t            srx_buf[BENCH_CHUNK];
+
+static io_net_t           nclient;
+static io_ssl_t           sclient;
+static uint8_t            crx_buf[128];
+
+static uint8_t            chunk[BENCH_CHUNK];
+
+static uint64_t           total;
+static uint64_t           sent;
+static uint64_t           received;
+static struct timespec    started;
+
+static double
+elapsed_sec(void)
+{
+  struct timespec   now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - started.tv_sec) + (now.tv_nsec - started.tv_nsec) / 1e9;
+}
+
+static void
+client_pump(void)
+{
+  int   ret;
+
+  while(sent < total)
+  {
+    ret = io_net_tx(&nclient, chunk, (int)MIN(total - sent, BENCH_CHUNK));
+    if(ret < 0)
+    {
+      LOGE(TAG, "client tx error\n");
+      exit(-1);
+    }
+
+    if(ret == 0)
+    {
+      // resumed on TX event
+      return;
+    }
+    sent += ret;
+  }
+}
+
+static io_net_return_t
+server_callback(io_net_t* n, io_net_event_t* e)
+{
+  double    sec;
+
+  switch(e->ev)
+  {
+  case io_net_event_enum_alloc_connection:
+    e->c.n = &nconn;
+    e->c.s = &sconn;
+    return io_net_return_continue;
+
+  case io_net_event_enum_connected:
+    io_net_set_rx_buf(n, srx_buf, sizeof(srx_buf));
+    return io_net_return_continue;
+
+  case io_net_event_enum_handshaken:
+    LOGI(TAG, "server handshaken. kTLS rx %d, tx %d\n", sconn.ktls_rx, sconn.ktls_tx);
+    return io_net_return_continue;
+
+  case io_net_event_enum_rx:
+    received += e->r.len;
+    if(received >= total)
+    {
+      sec = elapsed_sec();
+      LOGI(TAG, "%llu bytes in %.3f sec. %.1f MB/s\n",
+          (unsigned long long)received, sec, received / sec / (1024 * 1024));
+      exit(0);
+    }
+    return io_net_return_continue;
+
+  case io_net_event_enum_closed:
+    LOGE(TAG, "server connection closed after %llu bytes\n", (unsigned long long)received);
+    exit(-1);
+
+  default:
+    break;
+  }
+  return io_net_return_continue;
+}
+
+static io_net_return_t
+client_callback(io_net_t* n, io_net_event_t* e)
+{
+  switch(e->ev)
+  {
+  case io_net_event_enum_connected:
+    io_net_set_rx_buf(n, crx_buf, sizeof(crx_buf));
+    break;
+
+  case io_net_event_enum_handshaken:
+    LOGI(TAG, "client handshaken. kTLS rx %d, tx %d\n", sclient.ktls_rx, sclient.ktls_tx);
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    client_pump();
+    break;
+
+  case io_net_event_enum_tx:
+    client_pump();
+    break;
+
+  case io_net_event_enum_closed:
+    LOGE(TAG, "client connection closed\n");
+    exit(-1);
+
+  default:
+    break;
+  }
+  return io_net_return_continue;
+}
+
+int
+main(int argc, char** argv)
+{
+  int   ktls = argc > 1 ? atoi(argv[1]) : 1;
+  int   mbytes = argc > 2 ? atoi(argv[2]) : 256;
+
+  total = (uint64_t)mbytes * 1024 * 1024;
+  memset(chunk, 'k', sizeof(chunk));
+
+  io_driver_init(&io_driver);
+
+  if(io_ssl_ctx_init_server(&sctx) != 0 || io_ssl_ctx_init_client(&cctx) != 0)
+  {
+    LOGE(TAG, "failed to init ssl context\n");
+    return -1;
+  }
+
+  if(ktls && (io_ssl_ctx_enable_ktls(&sctx) != 0 || io_ssl_ctx_enable_ktls(&cctx) != 0))
+  {
+    LOGE(TAG, "failed to enable kTLS\n");
+    return -1;
+  }
+
+  LOGI(TAG, "sending %d MB over loopback TLS. kTLS %s\n", mbytes, ktls ? "on" : "off");
+
+  if(io_net_bind(&io_driver, &nserver, &sctx, BENCH_PORT, server_callback) != 0 ||
+     io_net_connect(&io_driver, &nclient, &cctx, &sclient, "127.0.0.1", BENCH_PORT, client_callback) != 0)
+  {
+    LOGE(TAG, "failed to setup connection\n");
+    return -1;
+  }
+
+  while(1)
+  {
+    io_driver_run(&io_driver);
+  }
+
+  return 0;
+}
@@ -0,0 +1,392 @@
+//
+// cache misses per dispatched event with many connections.
+//
+// walks watcher lists the way io_driver_run() does, once over
+// connections in current io_net_t/io_ssl_t/io_driver_watcher_t layout and
+// once over a replica of the old layout, with every connection ready.
+// the callback reads what io_ssl_generic_callback() reads before entering mbedtls.
+// the cache is flushed before each pass so that each pass starts cold,
+// like a busy server whose connections don't fit in cache.
+//
+// counts cache misses with perf_event_open(2). reports time only if unavailable.
+//
+// layout_bench [connections] [passes]
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "io_driver.h"
+#include "io_net.h"
+
+#define FLUSH_SIZE          (64 * 1024 * 1024)
+
+static const char* TAG = "main";
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// replica of the layout before hot/cold split
+//
+////////////////////////////////////////////////////////////////////////////////
+struct old_watcher;
+typedef void (*old_callback)(struct old_watcher* w, io_driver_event e);
+
+typedef struct old_watcher
+{
+  int                   fd;
+  uint8_t               event_listening;
+  old_callback          callback;
+  struct list_head      le;
+} old_watcher_t;
+
+typedef struct
+{
+  mbedtls_net_context   mbed_fd;
+  mbedtls_ssl_context   ssl;
+  io_ssl_ctx_t*         ctx;
+  uint8_t               handshaking;
+  uint8_t               resumed;
+  uint8_t               ktls_rx;
+  uint8_t               ktls_tx;
+} old_ssl_t;
+
+typedef struct
+{
+  int                   sd;
+  io_net_callback       cb;
+  old_watcher_t         watcher;
+  io_driver_t*          driver;
+  old_ssl_t*            ssl;
+  io_ssl_ctx_t*         ssl_ctx;
+  uint8_t*              rx_buf;
+  int                   rx_size;
+} old_net_t;
+
+typedef struct
+{
+  old_net_t             n;
+  old_ssl_t             s;
+  uint8_t               rx_buf[512];
+} old_conn_t;
+
+typedef struct
+{
+  io_net_t              n;
+  io_ssl_t              s;
+  uint8_t               rx_buf[512];
+} new_conn_t;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// measurement
+//
+////////////////////////////////////////////////////////////////////////////////
+typedef struct
+{
+  int                   fd_llc;
+  int                   fd_l1d;
+  uint64_t              llc;
+  uint64_t              l1d;
+  uint64_t              nsec;
+  struct timespec       started;
+} counters_t;
+
+static volatile uint64_t  sink;
+static uint8_t*           flush_buf;
+
+static int
+perf_open(uint32_t type, uint64_t config)
+{
+  struct perf_event_attr  attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size           = sizeof(attr);
+  attr.type           = type;
+  attr.config         = config;
+  attr.disabled       = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv     = 1;
+
+  return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void
+counters_init(counters_t* c)
+{
+  c->fd_llc = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+  c->fd_l1d = perf_open(PERF_TYPE_HW_CACHE,
+      PERF_COUNT_HW_CACHE_L1D |
+      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+  c->llc  = 0;
+  c->l1d  = 0;
+  c->nsec = 0;
+}
+
+static void
+counters_start(counters_t* c)
+{
+  for(int i = 0; i < FLUSH_SIZE; i += IO_CACHE_LINE)
+  {
+    flush_buf[i]++;
+  }
+
+  if(c->fd_llc >= 0)
+  {
+    ioctl(c->fd_llc, PERF_EVENT_IOC_RESET, 0);
+    ioctl(c->fd_llc, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  if(c->fd_l1d >= 0)
+  {
+    ioctl(c->fd_l1d, PERF_EVENT_IOC_RESET, 0);
+    ioctl(c->fd_l1d, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &c->started);
+}
+
+static void
+counters_stop(counters_t* c)
+{
+  struct timespec   now;
+  uint64_t          v;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  c->nsec += (now.tv_sec - c->started.tv_sec) * 1000000000ULL + now.tv_nsec - c->started.tv_nsec;
+
+  if(c->fd_llc >= 0)
+  {
+    ioctl(c->fd_llc, PERF_EVENT_IOC_DISABLE, 0);
+    if(read(c->fd_llc, &v, sizeof(v)) == sizeof(v))
+    {
+      c->llc += v;
+    }
+  }
+  if(c->fd_l1d >= 0)
+  {
+    ioctl(c->fd_l1d, PERF_EVENT_IOC_DISABLE, 0);
+    if(read(c->fd_l1d, &v, sizeof(v)) == sizeof(v))
+    {
+      c->l1d += v;
+    }
+  }
+}
+
+static void
+counters_report(counters_t* c, const char* name, uint64_t events)
+{
+  if(c->fd_llc >= 0 && c->fd_l1d >= 0)
+  {
+    LOGI(TAG, "%s: %.2f L1D misses/event, %.2f LLC misses/event, %.1f ns/event\n",
+        name, (double)c->l1d / events, (double)c->llc / events, (double)c->nsec / events);
+  }
+  else
+  {
+    LOGI(TAG, "%s: perf counters unavailable. %.1f ns/event\n", name, (double)c->nsec / events);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// dispatch. same access pattern as preselect/postselect
+//
+////////////////////////////////////////////////////////////////////////////////
+static void
+new_callback(io_driver_watcher_t* w, io_driver_event e)
+{
+  io_net_t*   n = container_of(w, io_net_t, watcher);
+  io_ssl_t*   s = n->ssl;
+
+  sink += n->sd + (uintptr_t)n->cb + (uintptr_t)n->rx_buf + n->rx_size +
+          s->handshaking + s->ktls_rx + s->rec_small;
+}
+
+static void
+new_dispatch(struct list_head* watchers)
+{
+  io_driver_watcher_t*  w;
+  int                   maxfd = 0;
+
+  list_for_each_entry(w, watchers, le)
+  {
+    if(w->event_listening & IO_DRIVER_EVENT_RX)
+    {
+      maxfd = MAX(w->fd, maxfd);
+    }
+  }
+
+  list_for_each_entry(w, watchers, le)
+  {
+    if(w->event_listening & IO_DRIVER_EVENT_RX)
+    {
+      w->callback(w, IO_DRIVER_EVENT_RX);
+    }
+  }
+  sink += maxfd;
+}
+
+static void
+old_callback_fn(old_watcher_t* w, io_driver_event e)
+{
+  old_net_t*  n = container_of(w, old_net_t, watcher);
+  old_ssl_t*  s = n->ssl;
+
+  sink += n->sd + (uintptr_t)n->cb + (uintptr_t)n->rx_buf + n->rx_size +
+          s->handshaking + s->ktls_rx;
+}
+
+static void
+old_dispatch(struct list_head* watchers)
+{
+  old_watcher_t*  w;
+  int             maxfd = 0;
+
+  list_for_each_entry(w, watchers, le)
+  {
+    if(w->event_listening & IO_DRIVER_EVENT_RX)
+    {
+      maxfd = MAX(w->fd, maxfd);
+    }
+  }
+
+  list_for_each_entry(w, watchers, le)
+  {
+    if(w->event_listening & IO_DRIVER_EVENT_RX)
+    {
+      w->callback(w, IO_DRIVER_EVENT_RX);
+    }
+  }
+  sink += maxfd;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// setup
+//
+////////////////////////////////////////////////////////////////////////////////
+
+//
+// connections are accepted in an order unrelated to where they sit in memory
+//
+static void
+shuffle(int* order, int num)
+{
+  int   j, t;
+
+  for(int i = 0; i < num; i++)
+  {
+    order[i] = i;
+  }
+
+  for(int i = num - 1; i > 0; i--)
+  {
+    j = rand() % (i + 1);
+    t = order[i];
+    order[i] = order[j];
+    order[j] = t;
+  }
+}
+
+int
+main(int argc, char** argv)
+{
+  int               num = argc > 1 ? atoi(argv[1]) : 10000;
+  int               passes = argc > 2 ? atoi(argv[2]) : 20;
+  int*              order;
+  new_conn_t**      nc;
+  old_conn_t**      oc;
+  struct list_head  new_watchers;
+  struct list_head  old_watchers;
+  counters_t        cnew, cold;
+  io_driver_t       driver;
+
+  io_driver_init(&driver);
+
+  flush_buf = malloc(FLUSH_SIZE);
+  order     = malloc(sizeof(int) * num);
+  nc        = malloc(sizeof(new_conn_t*) * num);
+  oc        = malloc(sizeof(old_conn_t*) * num);
+
+  if(flush_buf == NULL || order == NULL || nc == NULL || oc == NULL)
+  {
+    LOGE(TAG, "out of memory\n");
+    return -1;
+  }
+  memset(flush_buf, 0, FLUSH_SIZE);
+
+  INIT_LIST_HEAD(&new_watchers);
+  INIT_LIST_HEAD(&old_watchers);
+
+  //
+  // allocated interleaved as a server would over time
+  //
+  for(int i = 0; i < num; i++)
+  {
+    nc[i] = aligned_alloc(IO_CACHE_LINE, sizeof(new_conn_t));
+    oc[i] = aligned_alloc(IO_CACHE_LINE, (sizeof(old_conn_t) + IO_CACHE_LINE - 1) & ~(IO_CACHE_LINE - 1));
+    if(nc[i] == NULL || oc[i] == NULL)
+    {
+      LOGE(TAG, "out of memory\n");
+      return -1;
+    }
+    memset(nc[i], 0, sizeof(new_conn_t));
+    memset(oc[i], 0, sizeof(old_conn_t));
+  }
+
+  shuffle(order, num);
+  for(int i = 0; i < num; i++)
+  {
+    new_conn_t*   c = nc[order[i]];
+
+    c->n.sd       = i;
+    c->n.ssl      = &c->s;
+    c->n.rx_buf   = c->rx_buf;
+    c->n.rx_size  = sizeof(c->rx_buf);
+    c->n.driver   = &driver;
+    c->s.n        = &c->n;
+    io_driver_watcher_init(&c->n.watcher, i, new_callback);
+    c->n.watcher.event_listening = IO_DRIVER_EVENT_RX;
+    list_add_tail(&c->n.watcher.le, &new_watchers);
+  }
+
+  shuffle(order, num);
+  for(int i = 0; i < num; i++)
+  {
+    old_conn_t*   c = oc[order[i]];
+
+    c->n.sd       = i;
+    c->n.ssl      = &c->s;
+    c->n.rx_buf   = c->rx_buf;
+    c->n.rx_size  = sizeof(c->rx_buf);
+    c->n.driver   = &driver;
+    c->n.watcher.fd = i;
+    c->n.watcher.event_listening = IO_DRIVER_EVENT_RX;
+    c->n.watcher.callback = old_callback_fn;
+    list_add_tail(&c->n.watcher.le, &old_watchers);
+  }
+
+  LOGI(TAG, "%d connections, %d passes. io_net_t %zu bytes, io_ssl_t %zu bytes, watcher %zu bytes\n",
+      num, passes, sizeof(io_net_t), sizeof(io_ssl_t), sizeof(io_driver_watcher_t));
+
+  counters_init(&cnew);
+  counters_init(&cold);
+
+  for(int p = 0; p < passes; p++)
+  {
+    counters_start(&cold);
+    old_dispatch(&old_watchers);
+    counters_stop(&cold);
+
+    counters_start(&cnew);
+    new_dispatch(&new_watchers);
+    counters_stop(&cnew);
+  }
+
+  counters_report(&cold, "old layout", (uint64_t)num * passes);
+  counters_report(&cnew, "new layout", (uint64_t)num * passes);
+
+  return 0;
+}
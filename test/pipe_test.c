@@ -7,6 +7,7 @@
 
 #include "io_pipe.h"
 #include "io_timer.h"
+#include "io_watchdog.h"
 
 #define NUM_PIPE_TESTS      0
 
@@ -24,6 +25,7 @@ static const char* TAG = "main";
 
 static io_driver_t        io_driver;
 static io_timer_t         io_timer;
+static io_watchdog_t      io_watchdog;
 
 static pipe_test_work_t _works[NUM_PIPE_TESTS];
 
@@ -182,6 +184,15 @@ main(int argc, char** argv)
   io_driver_init(&io_driver);
   io_timer_init(&io_driver, &io_timer, 100);
 
+  //
+  // io_pipe_rx_callback() reaps the child with waitpid().
+  // anything that blocks long enough shows up here
+  //
+  if(io_watchdog_start(&io_watchdog, &io_driver, 10, 5) != 0)
+  {
+    LOGE(TAG, "failed to start watchdog\n");
+  }
+
   init_pipe_test_works();
 
   while(1)
@@ -10,6 +10,7 @@ static io_driver_t        io_driver;
 
 static io_net_t           nclient;
 static io_ssl_t           sclient;
+static io_ssl_ctx_t       cctx;
 
 static io_timer_t         io_timer;
 
@@ -26,7 +27,7 @@ static void
 start_connect(void)
 {
   LOGI(TAG, "starting connect %s:%d\n", ipaddr, port);
-  if(io_net_connect(&io_driver, &nclient, &sclient, ipaddr, port, ssl_client_callback) != 0)
+  if(io_net_connect(&io_driver, &nclient, &cctx, &sclient, ipaddr, port, ssl_client_callback) != 0)
   {
     LOGE(TAG, "io_telnet_connect returned NULL....\n");
     return;
@@ -71,7 +72,8 @@ ssl_client_callback(io_net_t* n, io_net_event_t* e)
     break;
 
   case io_net_event_enum_handshaken:
-    LOGI(TAG, "handshaken done\n");
+    LOGI(TAG, "handshaken done. full %u, resumed %u\n",
+        cctx.full_handshakes, cctx.resumed_handshakes);
     io_timer_stop(&io_timer, &conn_tmr);
 
     LOGI(TAG, "Starting Close Timer: 3000\n");
@@ -111,6 +113,13 @@ main(int argc, char** argv)
   port = atoi(argv[2]);
 
   io_driver_init(&io_driver);
+
+  if(io_ssl_ctx_init_client(&cctx) != 0)
+  {
+    LOGE(TAG, "failed to init ssl context\n");
+    return -1;
+  }
+
   io_timer_init(&io_driver, &io_timer, 100);
 
   soft_timer_init_elem(&reconn_tmr);
@@ -4,12 +4,15 @@
 #include "io_driver.h"
 #include "io_net.h"
 #include "circ_buffer.h"
+#include "io_static.h"
+#include "io_timer.h"
 
 #define HTTP_RESPONSE \
     "HTTP/1.0 200 OK\r\nContent-Type: text/html\r\n\r\n" \
     "<h2>mbed TLS Test Server</h2>\r\n" \
     "<p>Successful connection using: %s</p>\r\n"
 
+#define REPORT_PERIOD   10000     // msec
 
 typedef struct
 {
@@ -17,6 +20,7 @@ typedef struct
   io_net_t            n;
   io_ssl_t            sconn;
   uint8_t             rx_buf[128];
+  uint8_t             tx_buf[512];
   circ_buffer_t       txcb;
 } ssl_conn_t;
 
@@ -29,19 +33,29 @@ static io_driver_t        io_driver;
 static struct list_head   conns;
 
 static io_net_t           nserver;
-static io_ssl_t           sserver;
+static io_ssl_ctx_t       sctx;
+static io_offload_t       offload;
+static io_net_tcp_hist_t  tcp_hist;
+
+static io_timer_t         io_timer;
+static SoftTimerElem      report_tmr;
 
 static ssl_conn_t* 
 alloc_ssl_connection(void)
 {
   ssl_conn_t*   c;
 
-  c = malloc(sizeof(ssl_conn_t));
+  c = io_driver_alloc(&io_driver, io_alloc_app, sizeof(ssl_conn_t));
+  if(c == NULL)
+  {
+    return NULL;
+  }
+  memset(c, 0, sizeof(ssl_conn_t));
   INIT_LIST_HEAD(&c->le);
 
   list_add_tail(&c->le, &conns);
 
-  circ_buffer_init(&c->txcb, 512);
+  circ_buffer_init_with_allocator(&c->txcb, 512, io_driver.allocator);
 
   LOGI(TAG, "new connection :\n");
   return c;
@@ -53,7 +67,27 @@ dealloc_ssl_connection(ssl_conn_t* c)
   io_net_close(&c->n);
   circ_buffer_deinit(&c->txcb);
   list_del(&c->le);
-  free(c);
+  io_driver_free(&io_driver, io_alloc_app, c, sizeof(ssl_conn_t));
+}
+
+//
+// server wide statistics. reported periodically instead of per connection
+//
+static void
+report_timeout(SoftTimerElem* te)
+{
+  const io_net_mem_t*   mem = io_net_mem_stats(&io_driver);
+
+  LOGI(TAG, "handshakes active %d, queued %d, peak %u, waited %u, max wait %u us, rejected %u\n",
+      sctx.hs_active, sctx.hs_queued, sctx.hs_queue_peak,
+      sctx.hs_waited, sctx.hs_wait_max_us, sctx.hs_rejected);
+  LOGI(TAG, "connection memory %llu bytes, peak %llu, paused %u, rejected %u\n",
+      (unsigned long long)mem->total, (unsigned long long)mem->peak, mem->paused, mem->rejected);
+  io_allocator_dump(io_driver.allocator);
+  io_static_dump();
+  io_net_tcp_hist_dump(&tcp_hist);
+
+  io_timer_start(&io_timer, &report_tmr, REPORT_PERIOD);
 }
 
 static void
@@ -64,7 +98,7 @@ ssl_tx_resume(ssl_conn_t* c)
             ret,
             len;
 
-  LOGI(TAG, "cli_tx_resume\n");
+  LOGD(TAG, "cli_tx_resume\n");
 
   while(1)
   {
@@ -109,7 +143,7 @@ ssl_tx(ssl_conn_t* c, uint8_t* buf, int len)
 
   while(nwritten < len)
   {
-    ret = io_net_tx(&c->n, (uint8_t*)buf, len);
+    ret = io_net_tx(&c->n, (uint8_t*)&buf[nwritten], len - nwritten);
     if(ret == 0)
     {
       ret = circ_buffer_put(&c->txcb, (uint8_t*)&buf[nwritten], len - nwritten);
@@ -152,6 +186,7 @@ ssl_server_callback(io_net_t* n, io_net_event_t* e)
     LOGI(TAG, "new ssl connected\n");
     c = container_of(n, ssl_conn_t, n); 
     io_net_set_rx_buf(n, c->rx_buf, 128);
+    io_ssl_set_tx_buf(&c->sconn, c->tx_buf, sizeof(c->tx_buf));
     return io_net_return_continue;
 
   case io_net_event_enum_rx:
@@ -181,15 +216,43 @@ ssl_server_callback(io_net_t* n, io_net_event_t* e)
 }
 
 int
-main()
+main(int argc, char** argv)
 {
   LOGI(TAG, "starting ssl server\n");
 
   INIT_LIST_HEAD(&conns);
 
   io_driver_init(&io_driver);
+  io_log_start();
+
+  if(io_ssl_ctx_init_server(&sctx) != 0)
+  {
+    LOGE(TAG, "failed to init ssl context\n");
+    return -1;
+  }
+
+  //
+  // ssl_server [num handshake workers]
+  //
+  if(argc > 1)
+  {
+    if(io_offload_init(&io_driver, &offload, atoi(argv[1])) != 0 ||
+       io_ssl_ctx_enable_offload(&sctx, &offload) != 0)
+    {
+      LOGE(TAG, "failed to enable handshake offload\n");
+      return -1;
+    }
+    LOGI(TAG, "handshake offload with %d workers\n", offload.num_threads);
+  }
+
+  io_net_bind(&io_driver, &nserver, &sctx, 11070, ssl_server_callback);
+  io_net_tcp_hist_init(&tcp_hist);
+  io_net_tcp_info_attach(&nserver, &tcp_hist);
 
-  io_net_bind(&io_driver, &nserver, &sserver, 11070, ssl_server_callback);
+  io_timer_init(&io_driver, &io_timer, 100);
+  soft_timer_init_elem(&report_tmr);
+  report_tmr.cb = report_timeout;
+  io_timer_start(&io_timer, &report_tmr, REPORT_PERIOD);
 
   while(1)
   {
@@ -0,0 +1,64 @@
+//
+// converts a trace saved by io_trace_save() to Chrome trace event JSON.
+// load the output in chrome://tracing or ui.perfetto.dev
+//
+// trace_dump <trace file> [json file]
+//
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "io_trace.h"
+
+static const char* TAG = "main";
+
+int
+main(int argc, char** argv)
+{
+  io_trace_file_hdr_t   hdr;
+  io_trace_event_t*     ev;
+  FILE*                 in;
+  FILE*                 out = stdout;
+  int                   ret;
+
+  if(argc < 2)
+  {
+    LOGE(TAG, "usage: %s <trace file> [json file]\n", argv[0]);
+    return -1;
+  }
+
+  in = fopen(argv[1], "r");
+  if(in == NULL)
+  {
+    LOGE(TAG, "failed to open %s\n", argv[1]);
+    return -1;
+  }
+
+  if(fread(&hdr, sizeof(hdr), 1, in) != 1 || hdr.magic != IO_TRACE_MAGIC)
+  {
+    LOGE(TAG, "%s is not a trace\n", argv[1]);
+    return -1;
+  }
+
+  ev = malloc(sizeof(io_trace_event_t) * (hdr.num + 1));
+  if(ev == NULL || fread(ev, sizeof(io_trace_event_t), hdr.num, in) != hdr.num)
+  {
+    LOGE(TAG, "failed to read %u events\n", hdr.num);
+    return -1;
+  }
+  fclose(in);
+
+  if(argc > 2 && (out = fopen(argv[2], "w")) == NULL)
+  {
+    LOGE(TAG, "failed to open %s\n", argv[2]);
+    return -1;
+  }
+
+  ret = io_trace_write_json(out, &hdr, ev);
+
+  if(out != stdout)
+  {
+    fclose(out);
+  }
+  free(ev);
+  return ret;
+}